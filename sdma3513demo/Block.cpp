@@ -39,32 +39,11 @@ uint32_t Block::get_block_max_health(BlockType type)
 }
 
 
-Block::Block(BlockType type, uint32_t health) :
-	type_(type)
-{
-	set_health(health);
-
-	const auto color_noise = Helper::get_random_int(205, 255);
-	block_color_mul_ = sf::Color(color_noise, color_noise, color_noise, 255);
-}
-
-
-Block::Block(BlockType type) :
-	Block(type, get_block_max_health(type))
-{
-}
-
-
-Block::~Block()
-{
-}
-
-
-void Block::render(sf::RenderTarget& target, const sf::Vector2f& draw_pos, const sf::Vector2f& draw_size, float draw_rotation)
+sf::Color Block::get_block_color(BlockType type, uint32_t health, sf::Uint8 color_noise)
 {
 	sf::Color block_color;
 
-	switch (type_) {
+	switch (type) {
 	case BlockType::Dirt:
 		block_color = sf::Color(153, 102, 51);
 		break;
@@ -78,7 +57,7 @@ void Block::render(sf::RenderTarget& target, const sf::Vector2f& draw_pos, const
 		break;
 
 	case BlockType::Glass:
-		block_color = is_destroyed() ? sf::Color(51, 153, 255) : sf::Color(255, 255, 0);
+		block_color = health == 0 ? sf::Color(51, 153, 255) : sf::Color(255, 255, 0);
 		break;
 
 	case BlockType::Stone:
@@ -94,27 +73,68 @@ void Block::render(sf::RenderTarget& target, const sf::Vector2f& draw_pos, const
 		break;
 
 	case BlockType::FireFX:
-		block_color = sf::Color(255, Helper::get_random_int(0, 185), 0);
+		block_color = get_fire_color(Helper::get_rng());
 		break;
 
 	default:
-		return;
+		return sf::Color(0, 0, 0, 0);
 	}
 
-	if (type_ != BlockType::FireFX && type_ != BlockType::Water) {
+	if (type != BlockType::FireFX && type != BlockType::Water) {
 		// health of block modifies the color
-		const auto color_multi = std::min(0.35f + (0.65f * (health_ / static_cast<float>(get_max_health()))), 1.0f);
+		const auto color_multi = std::min(0.35f + (0.65f * (health / static_cast<float>(get_block_max_health(type)))), 1.0f);
 		block_color.r = static_cast<sf::Uint8>(block_color.r * color_multi);
 		block_color.g = static_cast<sf::Uint8>(block_color.g * color_multi);
 		block_color.b = static_cast<sf::Uint8>(block_color.b * color_multi);
 
 		// Apply noise
-		block_color *= block_color_mul_;
+		block_color *= sf::Color(color_noise, color_noise, color_noise, 255);
 	}
 
+	return block_color;
+}
+
+
+sf::Color Block::get_fire_color(std::mt19937& rng)
+{
+	return sf::Color(255, static_cast<sf::Uint8>(Helper::get_random_int(rng, 0, 185)), 0);
+}
+
+
+void Block::render_block(sf::RenderTarget& target, const sf::Color& block_color, const sf::Vector2f& draw_pos, const sf::Vector2f& draw_size, float draw_rotation)
+{
 	sf::RectangleShape block(draw_size);
 	block.setFillColor(block_color);
 	block.setPosition(draw_pos);
 	block.setRotation(draw_rotation);
 	target.draw(block);
+}
+
+
+Block::Block(BlockType type, uint32_t health, sf::Uint8 color_noise) :
+	type_(type),
+	color_noise_(color_noise)
+{
+	set_health(health);
+}
+
+
+Block::Block(BlockType type) :
+	Block(type, get_block_max_health(type))
+{
+}
+
+
+Block::~Block()
+{
+}
+
+
+void Block::render(sf::RenderTarget& target, const sf::Vector2f& draw_pos, const sf::Vector2f& draw_size, float draw_rotation)
+{
+	const auto block_color = get_block_color(type_, health_, color_noise_);
+	if (block_color.a == 0)
+		return;
+
+	render_block(target, block_color, draw_pos, draw_size, draw_rotation);
 }
\ No newline at end of file
@@ -2,10 +2,11 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <random>
 
 #include <SFML/Graphics/RenderTarget.hpp>
 
-enum class BlockType
+enum class BlockType : uint8_t
 {
 	Stone,
 	Dirt,
@@ -14,22 +15,50 @@ enum class BlockType
 	Glass,
 	Bedrock,
 	Water,
-	FireFX
+	FireFX,
+
+	None = 0xFF // sentinel for empty cells in the world's block grid
 };
 
+// bitmask of BlockTypes, where bit n is set for the BlockType with a value of n
+typedef uint32_t BlockTypeMask;
+
 class Block
 {
 	BlockType type_;
 	uint32_t health_;
-	sf::Color block_color_mul_;
+	sf::Uint8 color_noise_;
 
 public:
 	static const sf::Vector2f BLOCK_SIZE;
 
+	// amount of real block types (excludes BlockType::None)
+	static const uint32_t BLOCK_TYPE_COUNT = static_cast<uint32_t>(BlockType::FireFX) + 1;
+	static const BlockTypeMask BLOCK_TYPE_MASK_ALL = (1U << BLOCK_TYPE_COUNT) - 1;
+
+	static inline BlockTypeMask get_block_type_mask(BlockType type) { return 1U << static_cast<uint32_t>(type); }
+
 	static uint32_t get_block_max_health(BlockType type);
+	static inline bool is_block_type_damageable(BlockType type) { return type != BlockType::Bedrock && type != BlockType::Water; }
+
+	// range of the noise applied to block colors, where 255 is no noise
+	static const sf::Uint8 MIN_COLOR_NOISE = 205;
+	static const sf::Uint8 MAX_COLOR_NOISE = 255;
+
+	/**
+	 * Returns the color a block of this type and health should be drawn with.
+	 * Returns a fully transparent color if the type has no visual.
+	 */
+	static sf::Color get_block_color(BlockType type, uint32_t health, sf::Uint8 color_noise);
+
+	// color of a FireFX block or fire gib, which flickers - rolled from the given RNG so that any thread can use one of its own
+	static sf::Color get_fire_color(std::mt19937& rng);
+
+	static void render_block(sf::RenderTarget& target, const sf::Color& block_color, const sf::Vector2f& draw_pos,
+		const sf::Vector2f& draw_size = BLOCK_SIZE, float draw_rotation = 0.0f);
 
 	// even setting the health through ctor will NOT allow it to be > max health
-	Block(BlockType type, uint32_t health);
+	Block(BlockType type, uint32_t health, sf::Uint8 color_noise = MAX_COLOR_NOISE);
 	Block(BlockType type);
 	~Block();
 
@@ -40,13 +69,15 @@ public:
 	inline void set_health(uint32_t new_health) { health_ = std::min(new_health, get_max_health()); }
 	inline void damage(uint32_t damage_amount)
 	{
-		if (type_ != BlockType::Bedrock && type_ != BlockType::Water)
+		if (is_block_type_damageable(type_))
 			health_ -= std::min(damage_amount, health_);
 	}
 
 	inline uint32_t get_health() const { return health_; }
 	inline uint32_t get_max_health() const { return get_block_max_health(type_); }
 
+	inline sf::Uint8 get_color_noise() const { return color_noise_; }
+
 	inline bool is_destroyed() const { return health_ == 0; }
 };
 
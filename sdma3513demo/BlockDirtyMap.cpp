@@ -0,0 +1,59 @@
+#include "BlockDirtyMap.h"
+
+#include <algorithm>
+
+
+BlockDirtyMap::BlockDirtyMap(uint32_t width, uint32_t height) :
+	width_(width),
+	height_(height),
+	tiles_width_((width + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT),
+	tiles_height_((height + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT)
+{
+	const auto tile_count = static_cast<std::size_t>(tiles_width_) * tiles_height_;
+	rows_.resize(tile_count << BlockChunk::SIZE_SHIFT, 0);
+	tile_row_masks_.resize(tile_count, 0);
+	tile_list_positions_.resize(tile_count, 0);
+}
+
+
+BlockDirtyMap::~BlockDirtyMap()
+{
+}
+
+
+void BlockDirtyMap::mark_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	x_end = std::min(x_end, width_);
+	y_end = std::min(y_end, height_);
+	if (x_begin >= x_end || y_begin >= y_end)
+		return;
+
+	for (uint32_t tile_y = y_begin >> BlockChunk::SIZE_SHIFT; tile_y <= ((y_end - 1) >> BlockChunk::SIZE_SHIFT); ++tile_y) {
+		const auto tile_start_y = tile_y << BlockChunk::SIZE_SHIFT;
+		const auto local_y_begin = std::max(y_begin, tile_start_y) - tile_start_y;
+		const auto local_y_end = std::min(y_end, tile_start_y + BlockChunk::SIZE) - tile_start_y;
+
+		for (uint32_t tile_x = x_begin >> BlockChunk::SIZE_SHIFT; tile_x <= ((x_end - 1) >> BlockChunk::SIZE_SHIFT); ++tile_x) {
+			const auto tile_start_x = tile_x << BlockChunk::SIZE_SHIFT;
+			const auto row_bits = Helper::get_bit_range_mask(std::max(x_begin, tile_start_x) - tile_start_x,
+				std::min(x_end, tile_start_x + BlockChunk::SIZE) - tile_start_x);
+
+			const auto tile_index = get_tile_index(tile_x, tile_y);
+			for (uint32_t local_y = local_y_begin; local_y < local_y_end; ++local_y)
+				mark_row_bits(tile_index, local_y, row_bits);
+		}
+	}
+}
+
+
+void BlockDirtyMap::clear()
+{
+	for (const auto tile_index : dirty_tiles_) {
+		std::fill(rows_.begin() + (static_cast<std::size_t>(tile_index) << BlockChunk::SIZE_SHIFT),
+			rows_.begin() + (static_cast<std::size_t>(tile_index + 1) << BlockChunk::SIZE_SHIFT), 0);
+		tile_row_masks_[tile_index] = 0;
+		tile_list_positions_[tile_index] = 0;
+	}
+
+	dirty_tiles_.clear();
+}
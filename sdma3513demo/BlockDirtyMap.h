@@ -0,0 +1,207 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include "BlockGrid.h"
+#include "Helper.h"
+
+/**
+ * Set of cells of a BlockGrid that need updating, as one bit per cell.
+ * Marking a cell is idempotent, so the cost of consuming the set only depends on the amount of distinct cells marked.
+ *
+ * Cells are grouped into tiles the size of a BlockChunk (one word per row). Each tile keeps a summary of which of its rows
+ * have marked cells, and tiles with any marked cells are listed in the order they were first marked, so consume() only ever
+ * visits set bits. consume_tile() takes a tile out of the middle of the list by moving the last one into its place, so maps
+ * drained with it give up that order.
+ */
+class BlockDirtyMap
+{
+	uint32_t width_, height_;
+	uint32_t tiles_width_, tiles_height_;
+
+	// BlockChunk::SIZE rows per tile
+	std::vector<uint64_t> rows_;
+
+	// bit n is set if row n of the tile has marked cells
+	std::vector<uint64_t> tile_row_masks_;
+
+	std::vector<uint32_t> dirty_tiles_;
+
+	// 1 + the index of each tile in dirty_tiles_, or 0 if it isn't listed
+	std::vector<uint32_t> tile_list_positions_;
+
+	inline std::size_t get_tile_index(uint32_t tile_x, uint32_t tile_y) const { return tile_x + (static_cast<std::size_t>(tiles_width_) * tile_y); }
+
+	inline void mark_row_bits(std::size_t tile_index, uint32_t local_y, uint64_t row_bits)
+	{
+		rows_[(tile_index << BlockChunk::SIZE_SHIFT) + local_y] |= row_bits;
+		tile_row_masks_[tile_index] |= static_cast<uint64_t>(1) << local_y;
+
+		if (tile_list_positions_[tile_index] == 0) {
+			dirty_tiles_.push_back(static_cast<uint32_t>(tile_index));
+			tile_list_positions_[tile_index] = static_cast<uint32_t>(dirty_tiles_.size());
+		}
+	}
+
+public:
+	BlockDirtyMap(uint32_t width, uint32_t height);
+	~BlockDirtyMap();
+
+	inline void mark(uint32_t x, uint32_t y)
+	{
+		mark_row_bits(get_tile_index(x >> BlockChunk::SIZE_SHIFT, y >> BlockChunk::SIZE_SHIFT), y & BlockChunk::SIZE_MASK,
+			static_cast<uint64_t>(1) << (x & BlockChunk::SIZE_MASK));
+	}
+
+	// marks the cells of the given bits of row y of a tile at once
+	inline void mark_tile_row(uint32_t tile_x, uint32_t y, uint64_t row_bits)
+	{
+		mark_row_bits(get_tile_index(tile_x, y >> BlockChunk::SIZE_SHIFT), y & BlockChunk::SIZE_MASK, row_bits);
+	}
+
+	// marks every cell in [x_begin, x_end) x [y_begin, y_end) a row of a tile at a time
+	void mark_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+
+	inline bool is_marked(uint32_t x, uint32_t y) const
+	{
+		const auto tile_index = get_tile_index(x >> BlockChunk::SIZE_SHIFT, y >> BlockChunk::SIZE_SHIFT);
+		return ((rows_[(tile_index << BlockChunk::SIZE_SHIFT) + (y & BlockChunk::SIZE_MASK)] >> (x & BlockChunk::SIZE_MASK)) & 1) != 0;
+	}
+
+	void clear();
+
+	inline bool is_empty() const { return dirty_tiles_.empty(); }
+	inline std::size_t get_dirty_tile_count() const { return dirty_tiles_.size(); }
+
+	// tiles with marked cells, in the order they were first marked (unless consume_tile() was used)
+	inline const std::vector<uint32_t>& get_dirty_tiles() const { return dirty_tiles_; }
+	inline bool is_tile_dirty(uint32_t tile_index) const { return tile_list_positions_[tile_index] != 0; }
+
+	inline uint32_t get_tile_index_at(uint32_t x, uint32_t y) const { return static_cast<uint32_t>(get_tile_index(x >> BlockChunk::SIZE_SHIFT, y >> BlockChunk::SIZE_SHIFT)); }
+	inline uint32_t get_tiles_width() const { return tiles_width_; }
+	inline uint32_t get_tiles_height() const { return tiles_height_; }
+
+	/**
+	 * Calls func(x, y) for up to max_cells marked cells, unmarking them. Tiles are visited in the order they're listed.
+	 * Cells that func marks may be left for the next call. Returns the amount of cells visited.
+	 */
+	template <typename Func>
+	uint32_t consume(Func func, uint32_t max_cells = std::numeric_limits<uint32_t>::max());
+
+	/**
+	 * Calls func(x_begin, x_end, y) for every run of consecutive marked cells in a row of the tile, unmarking them and delisting
+	 * the tile in constant time. Returns the amount of cells visited.
+	 */
+	template <typename Func>
+	uint32_t consume_tile(uint32_t tile_index, Func func);
+};
+
+template <typename Func>
+uint32_t BlockDirtyMap::consume(Func func, uint32_t max_cells)
+{
+	uint32_t visited_cells = 0;
+	std::size_t consumed_tiles = 0;
+	const std::size_t tile_count = dirty_tiles_.size();
+
+	while (consumed_tiles < tile_count && visited_cells < max_cells) {
+		const auto tile_index = dirty_tiles_[consumed_tiles];
+		const uint32_t tile_x = (tile_index % tiles_width_) << BlockChunk::SIZE_SHIFT;
+		const uint32_t tile_y = (tile_index / tiles_width_) << BlockChunk::SIZE_SHIFT;
+
+		// take the tile's marks before visiting them, so that func can mark cells of this tile again
+		auto row_mask = tile_row_masks_[tile_index];
+		tile_row_masks_[tile_index] = 0;
+		tile_list_positions_[tile_index] = 0;
+
+		uint64_t unvisited_row_bits = 0;
+		while (row_mask != 0) {
+			const auto local_y = Helper::count_trailing_zeros(row_mask);
+			const auto row_index = (static_cast<std::size_t>(tile_index) << BlockChunk::SIZE_SHIFT) + local_y;
+			auto row_bits = rows_[row_index];
+			rows_[row_index] = 0;
+
+			while (row_bits != 0 && visited_cells < max_cells) {
+				func(tile_x + Helper::count_trailing_zeros(row_bits), tile_y + local_y);
+				row_bits &= row_bits - 1;
+				++visited_cells;
+			}
+
+			if (row_bits != 0) {
+				unvisited_row_bits = row_bits; // out of budget
+				break;
+			}
+
+			row_mask &= row_mask - 1;
+		}
+
+		if (row_mask != 0) {
+			// put back what's left of the tile - the rows after the current one were never taken, so only their summary needs restoring
+			rows_[(static_cast<std::size_t>(tile_index) << BlockChunk::SIZE_SHIFT) + Helper::count_trailing_zeros(row_mask)] |= unvisited_row_bits;
+			tile_row_masks_[tile_index] |= row_mask;
+
+			// it keeps its place at the front, unless func has already listed it again at the back
+			if (tile_list_positions_[tile_index] != 0)
+				++consumed_tiles;
+			else
+				tile_list_positions_[tile_index] = static_cast<uint32_t>(consumed_tiles + 1);
+
+			break;
+		}
+
+		++consumed_tiles;
+	}
+
+	if (consumed_tiles > 0) {
+		dirty_tiles_.erase(dirty_tiles_.begin(), dirty_tiles_.begin() + consumed_tiles);
+		for (std::size_t i = 0; i < dirty_tiles_.size(); ++i)
+			tile_list_positions_[dirty_tiles_[i]] = static_cast<uint32_t>(i + 1);
+	}
+
+	return visited_cells;
+}
+
+template <typename Func>
+uint32_t BlockDirtyMap::consume_tile(uint32_t tile_index, Func func)
+{
+	const auto list_position = tile_list_positions_[tile_index];
+	if (list_position == 0)
+		return 0;
+
+	// the last listed tile takes its place, rather than shifting down every tile after it
+	const auto last_tile_index = dirty_tiles_.back();
+	dirty_tiles_[list_position - 1] = last_tile_index;
+	tile_list_positions_[last_tile_index] = list_position;
+	dirty_tiles_.pop_back();
+	tile_list_positions_[tile_index] = 0;
+
+	const uint32_t tile_x = (tile_index % tiles_width_) << BlockChunk::SIZE_SHIFT;
+	const uint32_t tile_y = (tile_index / tiles_width_) << BlockChunk::SIZE_SHIFT;
+	uint32_t visited_cells = 0;
+
+	auto row_mask = tile_row_masks_[tile_index];
+	tile_row_masks_[tile_index] = 0;
+
+	while (row_mask != 0) {
+		const auto local_y = Helper::count_trailing_zeros(row_mask);
+		const auto row_index = (static_cast<std::size_t>(tile_index) << BlockChunk::SIZE_SHIFT) + local_y;
+		auto row_bits = rows_[row_index];
+		rows_[row_index] = 0;
+
+		while (row_bits != 0) {
+			const auto run_begin = Helper::count_trailing_zeros(row_bits);
+			const auto run_bits = row_bits >> run_begin;
+			const auto run_end = ~run_bits == 0 ? static_cast<uint32_t>(BlockChunk::SIZE) : run_begin + Helper::count_trailing_zeros(~run_bits);
+
+			func(tile_x + run_begin, tile_x + run_end, tile_y + local_y);
+			row_bits &= ~Helper::get_bit_range_mask(run_begin, run_end);
+			visited_cells += run_end - run_begin;
+		}
+
+		row_mask &= row_mask - 1;
+	}
+
+	return visited_cells;
+}
@@ -0,0 +1,345 @@
+#include "BlockGrid.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "Helper.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define BLOCK_GRID_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+BlockChunk::BlockChunk() :
+	block_count(0)
+{
+	// BlockType::None is 0xFF, so every byte of the type array gets the same value
+	std::memset(types, static_cast<int>(BlockType::None), sizeof(types));
+	std::memset(healths, 0, sizeof(healths));
+	std::memset(occupied_rows, 0, sizeof(occupied_rows));
+	std::memset(solid_rows, 0, sizeof(solid_rows));
+	std::memset(type_rows, 0, sizeof(type_rows));
+}
+
+
+void BlockChunk::set_cell(std::size_t i, BlockType type, uint16_t health)
+{
+	const auto row = i >> SIZE_SHIFT;
+	const auto bit = get_cell_bit(i);
+
+	if (types[i] == BlockType::None)
+		++block_count;
+	else
+		type_rows[static_cast<uint32_t>(types[i])][row] &= ~bit;
+
+	types[i] = type;
+	occupied_rows[row] |= bit;
+	type_rows[static_cast<uint32_t>(type)][row] |= bit;
+	set_cell_health(i, health);
+}
+
+
+void BlockChunk::clear_cell(std::size_t i)
+{
+	if (types[i] == BlockType::None)
+		return;
+
+	type_rows[static_cast<uint32_t>(types[i])][i >> SIZE_SHIFT] &= ~get_cell_bit(i);
+	occupied_rows[i >> SIZE_SHIFT] &= ~get_cell_bit(i);
+	types[i] = BlockType::None;
+	set_cell_health(i, 0);
+	--block_count;
+}
+
+
+void BlockChunk::set_row_cells(uint32_t local_y, uint64_t row_bits, BlockType type, uint16_t health)
+{
+	if (row_bits == 0)
+		return;
+
+	// cells that had a block of another type lose it
+	const auto replaced_bits = occupied_rows[local_y] & row_bits;
+	if (replaced_bits != 0) {
+		for (uint32_t t = 0; t < Block::BLOCK_TYPE_COUNT; ++t)
+			type_rows[t][local_y] &= ~replaced_bits;
+	}
+
+	block_count += Helper::count_set_bits(row_bits) - Helper::count_set_bits(replaced_bits);
+	occupied_rows[local_y] |= row_bits;
+	type_rows[static_cast<uint32_t>(type)][local_y] |= row_bits;
+	if (health > 0)
+		solid_rows[local_y] |= row_bits;
+	else
+		solid_rows[local_y] &= ~row_bits;
+
+	const auto row_start = get_cell_index(0, local_y);
+	if (row_bits == ~static_cast<uint64_t>(0)) {
+		std::memset(types + row_start, static_cast<int>(type), SIZE);
+		std::fill(healths + row_start, healths + row_start + SIZE, health);
+		return;
+	}
+
+	while (row_bits != 0) {
+		const auto i = row_start + Helper::count_trailing_zeros(row_bits);
+		types[i] = type;
+		healths[i] = health;
+		row_bits &= row_bits - 1;
+	}
+}
+
+
+void BlockChunk::damage_row_span(uint32_t local_y, uint32_t x_begin, uint32_t x_end, const uint16_t* damages, uint64_t damage_bits)
+{
+	auto row_healths = healths + get_cell_index(x_begin, local_y);
+	const auto count = x_end - x_begin;
+	damage_bits >>= x_begin;
+
+	// bits of the cells of the span with no health left
+	uint64_t dead_bits = 0;
+	uint32_t i = 0;
+
+#ifdef BLOCK_GRID_USE_SSE2
+	const auto zero = _mm_setzero_si128();
+	const auto lane_bits = _mm_set_epi16(128, 64, 32, 16, 8, 4, 2, 1);
+
+	for (; i + 8 <= count; i += 8) {
+		// spread the 8 damage bits of these cells over their lanes, so cells not to be damaged take none
+		const auto bits_8 = _mm_set1_epi16(static_cast<short>((damage_bits >> i) & 0xFF));
+		const auto damage_lanes = _mm_cmpeq_epi16(_mm_and_si128(bits_8, lane_bits), lane_bits);
+		const auto damages_8 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(damages + i)), damage_lanes);
+
+		const auto healths_8 = _mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row_healths + i)), damages_8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(row_healths + i), healths_8);
+
+		const auto dead_8 = _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(healths_8, zero), zero)) & 0xFF;
+		dead_bits |= static_cast<uint64_t>(dead_8) << i;
+	}
+#endif
+
+	for (; i < count; ++i) {
+		if ((damage_bits >> i) & 1)
+			row_healths[i] = static_cast<uint16_t>(row_healths[i] - std::min(row_healths[i], damages[i]));
+		if (row_healths[i] == 0)
+			dead_bits |= static_cast<uint64_t>(1) << i;
+	}
+
+	solid_rows[local_y] &= ~(dead_bits << x_begin);
+}
+
+
+BlockChunk& BlockGrid::get_or_create_chunk(uint32_t chunk_x, uint32_t chunk_y)
+{
+	const auto chunk_index = get_chunk_index(chunk_x, chunk_y);
+	auto& chunk = chunks_[chunk_index];
+	if (!chunk) {
+		chunk = std::make_shared<BlockChunk>();
+		return *chunk;
+	}
+
+	return *get_writable_chunk(chunk_index);
+}
+
+
+uint32_t BlockGrid::find_column_top(uint32_t x, uint32_t y) const
+{
+	const auto chunk_x = x >> BlockChunk::SIZE_SHIFT;
+	const auto bit = static_cast<uint64_t>(1) << (x & BlockChunk::SIZE_MASK);
+
+	while (y < height_) {
+		const auto chunk = get_chunk(chunk_x, y >> BlockChunk::SIZE_SHIFT);
+		if (!chunk) {
+			// skip to the top of the next chunk down
+			y = (y | BlockChunk::SIZE_MASK) + 1;
+			continue;
+		}
+
+		if (chunk->occupied_rows[y & BlockChunk::SIZE_MASK] & bit)
+			return y;
+
+		++y;
+	}
+
+	return height_;
+}
+
+
+BlockGrid::BlockGrid(uint32_t width, uint32_t height) :
+	width_(width),
+	height_(height),
+	chunks_width_((width + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT),
+	chunks_height_((height + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT)
+{
+	const auto chunk_count = static_cast<std::size_t>(chunks_width_) * chunks_height_;
+	chunks_.resize(chunk_count);
+	chunks_dirty_.resize(chunk_count, 0);
+	column_tops_.resize(width_, height_);
+}
+
+
+BlockGrid::~BlockGrid()
+{
+}
+
+
+void BlockGrid::clear()
+{
+	for (auto& chunk : chunks_)
+		chunk.reset();
+
+	std::memset(chunks_dirty_.data(), 0, chunks_dirty_.size());
+	std::fill(column_tops_.begin(), column_tops_.end(), height_);
+}
+
+
+BlockRef BlockGrid::create_block_at(uint32_t x, uint32_t y, BlockType type)
+{
+	return set_block_at(x, y, Block(type));
+}
+
+
+BlockRef BlockGrid::set_block_at(uint32_t x, uint32_t y, const Block& block)
+{
+	check_bounds(x, y);
+
+	const auto chunk_x = x >> BlockChunk::SIZE_SHIFT;
+	const auto chunk_y = y >> BlockChunk::SIZE_SHIFT;
+	auto& chunk = get_or_create_chunk(chunk_x, chunk_y);
+	const auto i = BlockChunk::get_cell_index(x & BlockChunk::SIZE_MASK, y & BlockChunk::SIZE_MASK);
+	chunk.set_cell(i, block.get_type(), static_cast<uint16_t>(block.get_health()));
+	set_chunk_dirty(chunk_x, chunk_y, true);
+	column_tops_[x] = std::min(column_tops_[x], y);
+
+	return BlockRef(this, &chunk, get_chunk_index(chunk_x, chunk_y), i);
+}
+
+
+void BlockGrid::remove_block_at(uint32_t x, uint32_t y)
+{
+	check_bounds(x, y);
+
+	const auto chunk_x = x >> BlockChunk::SIZE_SHIFT;
+	const auto chunk_y = y >> BlockChunk::SIZE_SHIFT;
+	const auto chunk_index = get_chunk_index(chunk_x, chunk_y);
+	const auto i = BlockChunk::get_cell_index(x & BlockChunk::SIZE_MASK, y & BlockChunk::SIZE_MASK);
+	if (!chunks_[chunk_index] || chunks_[chunk_index]->types[i] == BlockType::None)
+		return;
+
+	auto chunk = get_writable_chunk(chunk_index);
+	chunk->clear_cell(i);
+	set_chunk_dirty(chunk_x, chunk_y, true);
+
+	// release chunks once they are fully empty
+	if (chunk->block_count == 0)
+		chunks_[chunk_index].reset();
+
+	if (column_tops_[x] == y)
+		column_tops_[x] = find_column_top(x, y + 1);
+}
+
+
+void BlockGrid::fill_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end, BlockType type, bool only_empty)
+{
+	if (x_begin >= x_end || y_begin >= y_end)
+		return;
+
+	check_bounds(x_begin, y_begin);
+	check_bounds(x_end - 1, y_end - 1);
+
+	const auto health = static_cast<uint16_t>(Block::get_block_max_health(type));
+	for (uint32_t chunk_y = y_begin >> BlockChunk::SIZE_SHIFT; chunk_y <= ((y_end - 1) >> BlockChunk::SIZE_SHIFT); ++chunk_y) {
+		const auto chunk_start_y = chunk_y << BlockChunk::SIZE_SHIFT;
+		const auto local_y_begin = std::max(y_begin, chunk_start_y) - chunk_start_y;
+		const auto local_y_end = std::min(y_end, chunk_start_y + BlockChunk::SIZE) - chunk_start_y;
+
+		for (uint32_t chunk_x = x_begin >> BlockChunk::SIZE_SHIFT; chunk_x <= ((x_end - 1) >> BlockChunk::SIZE_SHIFT); ++chunk_x) {
+			const auto chunk_start_x = chunk_x << BlockChunk::SIZE_SHIFT;
+			const auto row_mask = Helper::get_bit_range_mask(std::max(x_begin, chunk_start_x) - chunk_start_x,
+				std::min(x_end, chunk_start_x + BlockChunk::SIZE) - chunk_start_x);
+
+			auto& chunk = get_or_create_chunk(chunk_x, chunk_y);
+			for (uint32_t local_y = local_y_begin; local_y < local_y_end; ++local_y)
+				chunk.set_row_cells(local_y, only_empty ? row_mask & ~chunk.occupied_rows[local_y] : row_mask, type, health);
+
+			set_chunk_dirty(chunk_x, chunk_y, true);
+		}
+	}
+
+	// every cell of the rect has a block now
+	for (uint32_t x = x_begin; x < x_end; ++x)
+		column_tops_[x] = std::min(column_tops_[x], y_begin);
+}
+
+
+std::size_t BlockGrid::get_allocated_chunk_count() const
+{
+	std::size_t count = 0;
+	for (const auto& chunk : chunks_) {
+		if (chunk)
+			++count;
+	}
+
+	return count;
+}
+
+
+BlockChunk* BlockGrid::get_writable_chunk(std::size_t chunk_index)
+{
+	auto& chunk = chunks_[chunk_index];
+
+	// copy on write if a snapshot is still holding on to this chunk
+	if (chunk && chunk.use_count() > 1)
+		chunk = std::make_shared<BlockChunk>(*chunk);
+
+	return chunk.get();
+}
+
+
+BlockGridSnapshot BlockGrid::take_snapshot() const
+{
+	BlockGridSnapshot snapshot;
+	snapshot.width_ = width_;
+	snapshot.height_ = height_;
+	snapshot.chunks_ = chunks_;
+	snapshot.column_tops_ = column_tops_;
+	return snapshot;
+}
+
+
+void BlockGrid::restore_snapshot(const BlockGridSnapshot& snapshot, std::vector<sf::Vector2<uint32_t>>* changed_chunks)
+{
+	if (snapshot.width_ != width_ || snapshot.height_ != height_)
+		throw std::runtime_error("Cannot restore a snapshot of a BlockGrid with different dimensions");
+
+	for (uint32_t chunk_y = 0; chunk_y < chunks_height_; ++chunk_y) {
+		for (uint32_t chunk_x = 0; chunk_x < chunks_width_; ++chunk_x) {
+			const auto chunk_index = get_chunk_index(chunk_x, chunk_y);
+			if (chunks_[chunk_index] == snapshot.chunks_[chunk_index])
+				continue; // chunk never written to since the snapshot (or restored already)
+
+			chunks_[chunk_index] = snapshot.chunks_[chunk_index];
+			set_chunk_dirty(chunk_x, chunk_y, true);
+
+			if (changed_chunks)
+				changed_chunks->emplace_back(chunk_x, chunk_y);
+		}
+	}
+
+	column_tops_ = snapshot.column_tops_;
+}
+
+
+void BlockGrid::assign_chunks(std::vector<std::shared_ptr<BlockChunk>> chunks, std::vector<uint32_t> column_tops)
+{
+	if (chunks.size() != chunks_.size() || column_tops.size() != column_tops_.size())
+		throw std::runtime_error("Cannot assign chunks of a BlockGrid with different dimensions");
+
+	// chunks that were allocated before are dirty too, as their area may now be empty
+	for (std::size_t i = 0; i < chunks_.size(); ++i) {
+		if (chunks_[i] || chunks[i])
+			chunks_dirty_[i] = 1;
+	}
+
+	chunks_ = std::move(chunks);
+	column_tops_ = std::move(column_tops);
+}
\ No newline at end of file
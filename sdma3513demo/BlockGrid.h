@@ -0,0 +1,293 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+
+#include "Block.h"
+
+class BlockRef;
+
+/**
+ * Fixed size square of cells - the unit of allocation for a BlockGrid.
+ * Cells are stored row-major in structure-of-arrays form - empty cells have a type of BlockType::None.
+ *
+ * Each row of the chunk also has occupancy bitplanes (bit n = local x of n) for fast collision queries: one of non-empty cells,
+ * one of cells that are solid (present and not destroyed) and one per block type. Since SIZE is 64, a row of the chunk is exactly one word.
+ */
+struct BlockChunk
+{
+	static const uint32_t SIZE_SHIFT = 6;
+	static const uint32_t SIZE = 1 << SIZE_SHIFT;
+	static const uint32_t SIZE_MASK = SIZE - 1;
+	static const uint32_t CELL_COUNT = SIZE * SIZE;
+
+	BlockType types[CELL_COUNT];
+	uint16_t healths[CELL_COUNT];
+
+	uint64_t occupied_rows[SIZE];
+	uint64_t solid_rows[SIZE];
+	uint64_t type_rows[Block::BLOCK_TYPE_COUNT][SIZE];
+
+	// amount of non-empty cells - chunk is released once this hits 0
+	uint32_t block_count;
+
+	BlockChunk();
+
+	static inline std::size_t get_cell_index(uint32_t local_x, uint32_t local_y) { return local_x + (local_y << SIZE_SHIFT); }
+	static inline uint64_t get_cell_bit(std::size_t i) { return static_cast<uint64_t>(1) << (i & SIZE_MASK); }
+
+	// all writes to cells should go through these so that the bitplanes stay in sync
+	void set_cell(std::size_t i, BlockType type, uint16_t health);
+	void clear_cell(std::size_t i);
+
+	// sets the cells of the given bits of a local row at once - cheaper than set_cell() for each
+	void set_row_cells(uint32_t local_y, uint64_t row_bits, BlockType type, uint16_t health);
+
+	inline void set_cell_health(std::size_t i, uint16_t health)
+	{
+		healths[i] = health;
+		if (health > 0)
+			solid_rows[i >> SIZE_SHIFT] |= get_cell_bit(i);
+		else
+			solid_rows[i >> SIZE_SHIFT] &= ~get_cell_bit(i);
+	}
+
+	/**
+	 * Subtracts damages[0, x_end - x_begin) from the healths of the cells [x_begin, x_end) of a local row, saturating at 0.
+	 * Only the cells with their bit set in damage_bits are damaged. Cells left with no health are no longer solid.
+	 */
+	void damage_row_span(uint32_t local_y, uint32_t x_begin, uint32_t x_end, const uint16_t* damages, uint64_t damage_bits);
+
+	// returns the bits of the non-empty cells in the given local row that are of a type in the mask
+	inline uint64_t get_type_row_bits(uint32_t local_y, BlockTypeMask type_mask) const
+	{
+		uint64_t type_bits = 0;
+		for (uint32_t t = 0; t < Block::BLOCK_TYPE_COUNT; ++t) {
+			if (type_mask & (1U << t))
+				type_bits |= type_rows[t][local_y];
+		}
+
+		return type_bits;
+	}
+
+	/**
+	 * Returns the bits of the solid cells in the given local row that are of a type in the mask.
+	 */
+	inline uint64_t get_solid_row_bits(uint32_t local_y, BlockTypeMask type_mask) const
+	{
+		auto row_bits = solid_rows[local_y];
+		if ((type_mask & Block::BLOCK_TYPE_MASK_ALL) != Block::BLOCK_TYPE_MASK_ALL) {
+			uint64_t type_bits = 0;
+			for (uint32_t t = 0; t < Block::BLOCK_TYPE_COUNT; ++t) {
+				if (type_mask & (1U << t))
+					type_bits |= type_rows[t][local_y];
+			}
+
+			row_bits &= type_bits;
+		}
+
+		return row_bits;
+	}
+
+};
+
+class BlockGrid;
+
+/**
+ * Lightweight handle to a single cell of a BlockGrid.
+ * Evaluates to false if the cell is empty. Only valid until the grid is next modified, as removing blocks can release their chunk
+ * and writing to a chunk shared with a snapshot makes a copy of it.
+ */
+class BlockRef
+{
+	BlockGrid* grid_;
+	const BlockChunk* chunk_;
+	std::size_t chunk_index_, i_;
+
+	// makes sure the chunk is not shared with a snapshot before writing to it
+	inline BlockChunk& get_writable_chunk();
+
+public:
+	inline BlockRef() : grid_(nullptr), chunk_(nullptr), chunk_index_(0), i_(0) { }
+	inline BlockRef(BlockGrid* grid, const BlockChunk* chunk, std::size_t chunk_index, std::size_t i) :
+		grid_(grid), chunk_(chunk), chunk_index_(chunk_index), i_(i) { }
+
+	inline explicit operator bool() const { return chunk_ && chunk_->types[i_] != BlockType::None; }
+
+	inline BlockType get_type() const { return chunk_->types[i_]; }
+
+	inline void set_health(uint32_t new_health) { get_writable_chunk().set_cell_health(i_, static_cast<uint16_t>(std::min(new_health, get_max_health()))); }
+	inline void damage(uint32_t damage_amount)
+	{
+		if (Block::is_block_type_damageable(get_type()))
+			get_writable_chunk().set_cell_health(i_, static_cast<uint16_t>(get_health() - std::min(damage_amount, get_health())));
+	}
+
+	inline uint32_t get_health() const { return chunk_->healths[i_]; }
+	inline uint32_t get_max_health() const { return Block::get_block_max_health(get_type()); }
+
+	inline bool is_destroyed() const { return get_health() == 0; }
+
+	inline sf::Color get_color(sf::Uint8 color_noise) const { return Block::get_block_color(get_type(), get_health(), color_noise); }
+	inline Block to_block(sf::Uint8 color_noise) const { return Block(get_type(), get_health(), color_noise); }
+};
+
+/**
+ * Immutable copy of the state of a BlockGrid at some point in time.
+ * Chunks are shared with the grid it was taken from and only copied once the grid writes to them, so taking and restoring
+ * snapshots only costs as much as the chunks that changed in between.
+ */
+class BlockGridSnapshot
+{
+	friend class BlockGrid;
+
+	uint32_t width_, height_;
+	std::vector<std::shared_ptr<BlockChunk>> chunks_;
+	std::vector<uint32_t> column_tops_;
+
+public:
+	inline uint32_t get_width() const { return width_; }
+	inline uint32_t get_height() const { return height_; }
+};
+
+/**
+ * Sparse, chunked storage for the world's blocks.
+ * Chunks are only allocated once a block is placed inside of them and are released again once they become empty,
+ * so the mostly-empty sky costs nothing more than a null pointer per chunk.
+ *
+ * Chunks are copy-on-write - see take_snapshot().
+ *
+ * Writes to different columns of chunks touch no shared state, so they can safely be made from different threads.
+ */
+class BlockGrid
+{
+	uint32_t width_, height_;
+	uint32_t chunks_width_, chunks_height_;
+	std::vector<std::shared_ptr<BlockChunk>> chunks_;
+
+	// chunks that have been modified since the dirty flag was last cleared - kept outside of the chunk as
+	// releasing an emptied chunk still leaves its area dirty
+	std::vector<uint8_t> chunks_dirty_;
+
+	// y of the topmost non-empty cell of each column, or height_ if the column is empty
+	std::vector<uint32_t> column_tops_;
+
+	inline std::size_t get_chunk_index(uint32_t chunk_x, uint32_t chunk_y) const { return chunk_x + (static_cast<std::size_t>(chunks_width_) * chunk_y); }
+
+	inline void check_bounds(uint32_t x, uint32_t y) const
+	{
+		if (x >= width_ || y >= height_)
+			throw std::runtime_error("Block index out of range");
+	}
+
+	BlockChunk& get_or_create_chunk(uint32_t chunk_x, uint32_t chunk_y);
+
+	// finds the topmost non-empty cell of column x at or below y
+	uint32_t find_column_top(uint32_t x, uint32_t y) const;
+
+public:
+	BlockGrid(uint32_t width, uint32_t height);
+	BlockGrid(BlockGrid&&) = default;
+	~BlockGrid();
+
+	BlockGrid& operator=(BlockGrid&&) = default;
+
+	void clear();
+
+	BlockRef create_block_at(uint32_t x, uint32_t y, BlockType type);
+	BlockRef set_block_at(uint32_t x, uint32_t y, const Block& block);
+	void remove_block_at(uint32_t x, uint32_t y);
+
+	/**
+	 * Fills the cells in [x_begin, x_end) x [y_begin, y_end) with new blocks of the given type a row of a chunk at a time,
+	 * marking each chunk touched dirty once. If only_empty is true, cells that already have a block are left alone.
+	 */
+	void fill_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end, BlockType type, bool only_empty = false);
+
+	inline void fill_span(uint32_t x_begin, uint32_t x_end, uint32_t y, BlockType type, bool only_empty = false)
+	{
+		fill_rect(x_begin, y, x_end, y + 1, type, only_empty);
+	}
+
+	inline void fill_column(uint32_t x, uint32_t y_begin, uint32_t y_end, BlockType type, bool only_empty = false)
+	{
+		fill_rect(x, y_begin, x + 1, y_end, type, only_empty);
+	}
+
+	inline BlockRef get_block_at(uint32_t x, uint32_t y)
+	{
+		check_bounds(x, y);
+		return get_block_ref(x >> BlockChunk::SIZE_SHIFT, y >> BlockChunk::SIZE_SHIFT, BlockChunk::get_cell_index(x & BlockChunk::SIZE_MASK, y & BlockChunk::SIZE_MASK));
+	}
+
+	inline BlockRef get_block_ref(uint32_t chunk_x, uint32_t chunk_y, std::size_t i)
+	{
+		const auto chunk_index = get_chunk_index(chunk_x, chunk_y);
+		const auto chunk = chunks_[chunk_index].get();
+		return chunk ? BlockRef(this, chunk, chunk_index, i) : BlockRef();
+	}
+
+	// returns nullptr if the chunk has not been allocated (is empty)
+	inline const BlockChunk* get_chunk(uint32_t chunk_x, uint32_t chunk_y) const { return chunks_[get_chunk_index(chunk_x, chunk_y)].get(); }
+
+	/**
+	 * Returns the chunk for writing, copying it first if it is shared with a snapshot.
+	 * Returns nullptr if the chunk has not been allocated (is empty).
+	 */
+	BlockChunk* get_writable_chunk(std::size_t chunk_index);
+	inline BlockChunk* get_writable_chunk(uint32_t chunk_x, uint32_t chunk_y) { return get_writable_chunk(get_chunk_index(chunk_x, chunk_y)); }
+
+	inline bool is_chunk_dirty(uint32_t chunk_x, uint32_t chunk_y) const { return chunks_dirty_[get_chunk_index(chunk_x, chunk_y)] != 0; }
+	inline void set_chunk_dirty(uint32_t chunk_x, uint32_t chunk_y, bool dirty) { chunks_dirty_[get_chunk_index(chunk_x, chunk_y)] = dirty ? 1 : 0; }
+
+	std::size_t get_allocated_chunk_count() const;
+
+	/**
+	 * Freezes the current state of the grid. Chunks are shared with the snapshot until either side writes to them.
+	 */
+	BlockGridSnapshot take_snapshot() const;
+
+	/**
+	 * Restores the grid to the state of the snapshot.
+	 * Only chunks that differ from the snapshot are touched - these are marked dirty and returned through changed_chunks if not null.
+	 */
+	void restore_snapshot(const BlockGridSnapshot& snapshot, std::vector<sf::Vector2<uint32_t>>* changed_chunks = nullptr);
+
+	/**
+	 * Replaces the contents of the grid with the given chunks (one per chunk of the grid, null if empty) and column tops.
+	 * Every chunk allocated before or after is marked dirty. The chunks are adopted as they are, so they may alias memory owned by something
+	 * else (e.g a mapped WorldCache file) - writes still copy them first while anything else holds a reference to that memory.
+	 */
+	void assign_chunks(std::vector<std::shared_ptr<BlockChunk>> chunks, std::vector<uint32_t> column_tops);
+
+	/**
+	 * Returns the y of the topmost non-empty cell in column x, or the height of the grid if the column is empty.
+	 * Destroyed blocks still count until they are removed.
+	 */
+	inline uint32_t get_column_top(uint32_t x) const { return column_tops_[x]; }
+
+	// highest (smallest y) column top of the columns in [x_begin, x_end)
+	inline uint32_t get_highest_column_top(uint32_t x_begin, uint32_t x_end) const
+	{
+		uint32_t top = height_;
+		for (uint32_t x = x_begin; x < x_end; ++x)
+			top = std::min(top, column_tops_[x]);
+
+		return top;
+	}
+
+	inline uint32_t get_width() const { return width_; }
+	inline uint32_t get_height() const { return height_; }
+
+	inline uint32_t get_chunks_width() const { return chunks_width_; }
+	inline uint32_t get_chunks_height() const { return chunks_height_; }
+};
+
+inline BlockChunk& BlockRef::get_writable_chunk()
+{
+	const auto chunk = grid_->get_writable_chunk(chunk_index_);
+	chunk_ = chunk;
+	return *chunk;
+}
\ No newline at end of file
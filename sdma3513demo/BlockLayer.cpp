@@ -0,0 +1,358 @@
+#include "BlockLayer.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define BLOCK_LAYER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+	/**
+	 * Colors of every block type at every health before noise is applied, as RGBA bytes packed into a word.
+	 */
+	struct BlockShadeTable
+	{
+		uint32_t offsets[Block::BLOCK_TYPE_COUNT];
+		uint32_t max_healths[Block::BLOCK_TYPE_COUNT];
+		bool noisy[Block::BLOCK_TYPE_COUNT];
+		std::vector<uint32_t> colors;
+
+		BlockShadeTable()
+		{
+			for (uint32_t t = 0; t < Block::BLOCK_TYPE_COUNT; ++t) {
+				const auto type = static_cast<BlockType>(t);
+				offsets[t] = static_cast<uint32_t>(colors.size());
+				max_healths[t] = Block::get_block_max_health(type);
+				noisy[t] = type != BlockType::FireFX && type != BlockType::Water;
+
+				// a noise of 255 leaves the color as it is - fire flickers, so shade_row() never takes its color from here
+				for (uint32_t health = 0; health <= max_healths[t]; ++health) {
+					const auto color = type != BlockType::FireFX ? Block::get_block_color(type, health, Block::MAX_COLOR_NOISE) : sf::Color::Transparent;
+					const sf::Uint8 rgba[4] = { color.r, color.g, color.b, color.a };
+
+					uint32_t packed;
+					std::memcpy(&packed, rgba, sizeof(packed));
+					colors.push_back(packed);
+				}
+			}
+		}
+	};
+
+	const BlockShadeTable& get_block_shade_table()
+	{
+		static const BlockShadeTable table;
+		return table;
+	}
+
+	// same as the sf::Color modulation in Block::get_block_color() - the alpha of each pixel is left alone
+	void apply_color_noise(sf::Uint8* pixels, const sf::Uint8* noise, uint32_t count)
+	{
+		uint32_t i = 0;
+
+#ifdef BLOCK_LAYER_USE_SSE2
+		const auto zero = _mm_setzero_si128();
+		const auto one = _mm_set1_epi16(1);
+
+		for (; i + 4 <= count; i += 4) {
+			const auto pixels_4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + (i * 4)));
+			const auto noise_lo = _mm_set_epi16(255, noise[i + 1], noise[i + 1], noise[i + 1], 255, noise[i], noise[i], noise[i]);
+			const auto noise_hi = _mm_set_epi16(255, noise[i + 3], noise[i + 3], noise[i + 3], 255, noise[i + 2], noise[i + 2], noise[i + 2]);
+
+			// (c * n) / 255 for 16-bit products, exact for 8-bit c and n: (p + 1 + (p >> 8)) >> 8
+			auto lo = _mm_mullo_epi16(_mm_unpacklo_epi8(pixels_4, zero), noise_lo);
+			auto hi = _mm_mullo_epi16(_mm_unpackhi_epi8(pixels_4, zero), noise_hi);
+			lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + (i * 4)), _mm_packus_epi16(lo, hi));
+		}
+#endif
+
+		for (; i < count; ++i) {
+			for (uint32_t c = 0; c < 3; ++c)
+				pixels[(i * 4) + c] = static_cast<sf::Uint8>((pixels[(i * 4) + c] * noise[i]) / 255);
+		}
+	}
+}
+
+
+void BlockLayer::TileRects::init(uint32_t width, uint32_t height)
+{
+	tiles_width_ = (width + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT;
+	const uint32_t tiles_height = (height + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT;
+
+	rects_.assign(static_cast<std::size_t>(tiles_width_) * tiles_height, TileRect{ 0, 0, 0, 0 });
+	tiles_.clear();
+}
+
+
+void BlockLayer::TileRects::mark(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	for (uint32_t tile_y = y_begin >> BlockChunk::SIZE_SHIFT; tile_y <= ((y_end - 1) >> BlockChunk::SIZE_SHIFT); ++tile_y) {
+		for (uint32_t tile_x = x_begin >> BlockChunk::SIZE_SHIFT; tile_x <= ((x_end - 1) >> BlockChunk::SIZE_SHIFT); ++tile_x) {
+			const auto tile_index = tile_x + (tiles_width_ * tile_y);
+			const TileRect rect = {
+				std::max(x_begin, tile_x << BlockChunk::SIZE_SHIFT),
+				std::max(y_begin, tile_y << BlockChunk::SIZE_SHIFT),
+				std::min(x_end, (tile_x + 1) << BlockChunk::SIZE_SHIFT),
+				std::min(y_end, (tile_y + 1) << BlockChunk::SIZE_SHIFT)
+			};
+
+			auto& tile_rect = rects_[tile_index];
+			if (tile_rect.x_begin >= tile_rect.x_end) {
+				tile_rect = rect;
+				tiles_.push_back(tile_index);
+			}
+			else {
+				tile_rect.x_begin = std::min(tile_rect.x_begin, rect.x_begin);
+				tile_rect.y_begin = std::min(tile_rect.y_begin, rect.y_begin);
+				tile_rect.x_end = std::max(tile_rect.x_end, rect.x_end);
+				tile_rect.y_end = std::max(tile_rect.y_end, rect.y_end);
+			}
+		}
+	}
+}
+
+
+BlockLayer::BlockLayer(uint32_t width, uint32_t height, uint32_t max_level_count)
+{
+	if (max_level_count > MAX_LEVEL_COUNT)
+		max_level_count = MAX_LEVEL_COUNT;
+	else if (max_level_count == 0)
+		max_level_count = 1;
+
+	// halve until a level is a single pixel, rounding up so the last row and column of cells are still covered
+	uint32_t level_count = 1;
+	for (uint32_t w = width, h = height; level_count < max_level_count && (w > 1 || h > 1); ++level_count) {
+		w = (w + 1) >> 1;
+		h = (h + 1) >> 1;
+	}
+
+	levels_.resize(level_count);
+	for (uint32_t i = 0; i < level_count; ++i) {
+		auto& level = levels_[i];
+		level.width = i == 0 ? width : (levels_[i - 1].width + 1) >> 1;
+		level.height = i == 0 ? height : (levels_[i - 1].height + 1) >> 1;
+		level.pixels.resize(static_cast<std::size_t>(level.width) * level.height * 4, 0);
+		level.pending_upload.init(level.width, level.height);
+		level.pending_filter.init(level.width, level.height);
+	}
+
+	clear();
+}
+
+
+BlockLayer::~BlockLayer()
+{
+}
+
+
+void BlockLayer::mark_modified(uint32_t level, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	levels_[level].pending_upload.mark(x_begin, y_begin, x_end, y_end);
+	if (level + 1 < levels_.size())
+		levels_[level].pending_filter.mark(x_begin, y_begin, x_end, y_end);
+}
+
+
+void BlockLayer::filter_rect(uint32_t level, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	const auto& src = levels_[level - 1];
+	auto& dst = levels_[level];
+	x_end = std::min(x_end, dst.width);
+	y_end = std::min(y_end, dst.height);
+
+	for (uint32_t y = y_begin; y < y_end; ++y) {
+		// pixels past the edge of the level before count as transparent
+		const uint32_t src_row_count = std::min(2u, src.height - (y * 2));
+		auto out = dst.pixels.data() + (((static_cast<std::size_t>(y) * dst.width) + x_begin) * 4);
+
+		for (uint32_t x = x_begin; x < x_end; ++x, out += 4) {
+			const uint32_t src_column_count = std::min(2u, src.width - (x * 2));
+			uint32_t rgb_sums[3] = { 0, 0, 0 };
+			uint32_t alpha_sum = 0;
+
+			for (uint32_t sy = 0; sy < src_row_count; ++sy) {
+				auto in = src.pixels.data() + (((static_cast<std::size_t>((y * 2) + sy) * src.width) + (x * 2)) * 4);
+				for (uint32_t sx = 0; sx < src_column_count; ++sx, in += 4) {
+					// colors are weighted by their coverage, so that empty cells don't darken the blocks next to them
+					for (uint32_t c = 0; c < 3; ++c)
+						rgb_sums[c] += in[c] * in[3];
+
+					alpha_sum += in[3];
+				}
+			}
+
+			for (uint32_t c = 0; c < 3; ++c)
+				out[c] = alpha_sum > 0 ? static_cast<sf::Uint8>((rgb_sums[c] + (alpha_sum / 2)) / alpha_sum) : 0;
+
+			out[3] = static_cast<sf::Uint8>((alpha_sum + 2) / 4);
+		}
+	}
+
+	mark_modified(level, x_begin, y_begin, x_end, y_end);
+}
+
+
+void BlockLayer::update_levels(uint32_t last_level)
+{
+	for (uint32_t level = 1; level <= last_level; ++level) {
+		levels_[level - 1].pending_filter.consume([this, level](const TileRect& rect) {
+			filter_rect(level, rect.x_begin >> 1, rect.y_begin >> 1, (rect.x_end + 1) >> 1, (rect.y_end + 1) >> 1);
+		});
+	}
+}
+
+
+void BlockLayer::shade_row(const BlockType* types, const uint16_t* healths, uint32_t x, uint32_t y, uint32_t count, unsigned int seed, sf::Uint8* out)
+{
+	const auto& table = get_block_shade_table();
+	sf::Uint8 noise[BlockChunk::SIZE];
+
+	for (uint32_t run_start = 0; run_start < count; run_start += BlockChunk::SIZE) {
+		const auto run_count = std::min(count - run_start, static_cast<uint32_t>(BlockChunk::SIZE));
+
+		for (uint32_t i = 0; i < run_count; ++i) {
+			const auto t = static_cast<uint32_t>(types[run_start + i]);
+			uint32_t color = 0;
+			noise[i] = Block::MAX_COLOR_NOISE;
+
+			if (types[run_start + i] == BlockType::FireFX) {
+				// flickers, so it can't come from the table - it's rolled from the cell's position rather than the shared RNG, as
+				// rows may be shaded from several threads at once
+				std::mt19937 fire_rng(Helper::hash_coords(x + run_start + i, y, seed));
+				const auto fire_color = Block::get_fire_color(fire_rng);
+				const sf::Uint8 rgba[4] = { fire_color.r, fire_color.g, fire_color.b, fire_color.a };
+				std::memcpy(&color, rgba, sizeof(color));
+			}
+			else if (t < Block::BLOCK_TYPE_COUNT) {
+				color = table.colors[table.offsets[t] + std::min<uint32_t>(healths[run_start + i], table.max_healths[t])];
+				if (table.noisy[t])
+					noise[i] = get_color_noise(x + run_start + i, y, seed);
+			}
+
+			std::memcpy(out + ((run_start + i) * 4), &color, sizeof(color));
+		}
+
+		apply_color_noise(out + (run_start * 4), noise, run_count);
+	}
+}
+
+
+void BlockLayer::clear()
+{
+	// every level is transparent after this, so there's nothing to filter
+	for (auto& level : levels_) {
+		std::fill(level.pixels.begin(), level.pixels.end(), 0);
+		level.pending_filter.consume([](const TileRect&) { });
+		level.pending_upload.mark(0, 0, level.width, level.height);
+	}
+}
+
+
+void BlockLayer::shade_rect(const BlockGrid& blocks, unsigned int seed, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	shade_rect_pixels(blocks, seed, x_begin, y_begin, x_end, y_end);
+	mark_shaded(x_begin, y_begin, x_end, y_end);
+}
+
+
+void BlockLayer::mark_shaded(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	x_end = std::min(x_end, levels_[0].width);
+	y_end = std::min(y_end, levels_[0].height);
+	if (x_begin < x_end && y_begin < y_end)
+		mark_modified(0, x_begin, y_begin, x_end, y_end);
+}
+
+
+void BlockLayer::write_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end, const sf::Uint8* pixels)
+{
+	auto& base = levels_[0];
+	const auto rect_width = x_end - x_begin;
+	for (uint32_t y = y_begin; y < y_end; ++y) {
+		std::memcpy(base.pixels.data() + (((static_cast<std::size_t>(y) * base.width) + x_begin) * 4),
+			pixels + (static_cast<std::size_t>(y - y_begin) * rect_width * 4), rect_width * 4);
+	}
+
+	mark_shaded(x_begin, y_begin, x_end, y_end);
+}
+
+
+void BlockLayer::shade_rect_pixels(const BlockGrid& blocks, unsigned int seed, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	auto& base = levels_[0];
+	x_end = std::min(x_end, base.width);
+	y_end = std::min(y_end, base.height);
+	if (x_begin >= x_end || y_begin >= y_end)
+		return;
+
+	for (uint32_t chunk_y = y_begin >> BlockChunk::SIZE_SHIFT; chunk_y <= ((y_end - 1) >> BlockChunk::SIZE_SHIFT); ++chunk_y) {
+		const uint32_t start_y = chunk_y << BlockChunk::SIZE_SHIFT;
+		const uint32_t row_y_begin = std::max(start_y, y_begin);
+		const uint32_t row_y_end = std::min(start_y + BlockChunk::SIZE, y_end);
+
+		for (uint32_t chunk_x = x_begin >> BlockChunk::SIZE_SHIFT; chunk_x <= ((x_end - 1) >> BlockChunk::SIZE_SHIFT); ++chunk_x) {
+			const uint32_t start_x = chunk_x << BlockChunk::SIZE_SHIFT;
+			const uint32_t row_x_begin = std::max(start_x, x_begin);
+			const uint32_t row_x_end = std::min(start_x + BlockChunk::SIZE, x_end);
+			const auto chunk = blocks.get_chunk(chunk_x, chunk_y);
+
+			for (uint32_t y = row_y_begin; y < row_y_end; ++y) {
+				const auto out = base.pixels.data() + ((static_cast<std::size_t>(y) * base.width) + row_x_begin) * 4;
+
+				// empty chunks are fully transparent
+				if (!chunk)
+					std::memset(out, 0, (row_x_end - row_x_begin) * 4);
+				else {
+					const auto i = BlockChunk::get_cell_index(row_x_begin - start_x, y - start_y);
+					shade_row(chunk->types + i, chunk->healths + i, row_x_begin, y, row_x_end - row_x_begin, seed, out);
+				}
+			}
+		}
+	}
+}
+
+
+void BlockLayer::upload(uint32_t level)
+{
+	// levels past this one keep their pending filters until they're uploaded themselves
+	update_levels(level);
+
+	// textures are only created once they're needed, on whichever thread renders them
+	auto& upload_level = levels_[level];
+	if (upload_level.texture.getSize().x == 0 && !upload_level.texture.create(upload_level.width, upload_level.height)) {
+		fprintf(stderr, "Failed to create block layer texture! (level %d, %dx%d)\n", level, upload_level.width, upload_level.height);
+		throw std::runtime_error("Failed to create block layer texture");
+	}
+
+	upload_level.pending_upload.consume([this, &upload_level](const TileRect& rect) {
+		const auto rect_width = rect.x_end - rect.x_begin;
+		const auto rect_height = rect.y_end - rect.y_begin;
+
+		upload_pixels_.resize(static_cast<std::size_t>(rect_width) * rect_height * 4);
+		for (uint32_t y = 0; y < rect_height; ++y) {
+			std::memcpy(upload_pixels_.data() + (static_cast<std::size_t>(y) * rect_width * 4),
+				upload_level.pixels.data() + (((static_cast<std::size_t>(rect.y_begin + y) * upload_level.width) + rect.x_begin) * 4), rect_width * 4);
+		}
+
+		upload_level.texture.update(upload_pixels_.data(), rect_width, rect_height, rect.x_begin, rect.y_begin);
+	});
+}
+
+
+uint32_t BlockLayer::get_level_for_scale(float pixels_per_cell) const
+{
+	// a pixel of level n covers 2^n cells along each axis
+	uint32_t level = 0;
+	while (level + 1 < levels_.size() && pixels_per_cell * static_cast<float>(2u << level) <= 1.0f)
+		++level;
+
+	return level;
+}
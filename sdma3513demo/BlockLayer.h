@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <SFML/Graphics/Texture.hpp>
+
+#include "BlockGrid.h"
+#include "Helper.h"
+
+/**
+ * CPU-side RGBA raster of a BlockGrid and the textures it's uploaded to.
+ *
+ * Level 0 has one pixel per cell. Each level after it is a 2x2 box filter of the one before (with the alpha being the
+ * coverage of the cells), so that a level that matches the output resolution can be drawn instead of leaving the rasterizer
+ * to pick between cells - with a Block::BLOCK_SIZE of 0.5, level 1 is at screen resolution.
+ *
+ * Cells are shaded into level 0 a row of a chunk at a time. Only the bounding rect of the pixels modified within each
+ * chunk-sized tile is filtered into the other levels, and textures are only updated for the levels that are uploaded,
+ * so the cost of keeping them in sync scales with the changed area.
+ */
+class BlockLayer
+{
+	struct TileRect
+	{
+		uint32_t x_begin, y_begin, x_end, y_end;
+	};
+
+	// bounding rects of the modified pixels of each tile of a level
+	class TileRects
+	{
+		uint32_t tiles_width_;
+		std::vector<TileRect> rects_;
+		std::vector<uint32_t> tiles_;
+
+	public:
+		void init(uint32_t width, uint32_t height);
+		void mark(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+
+		// calls func(rect) for every marked rect, unmarking them
+		template <typename Func>
+		void consume(Func func);
+	};
+
+	struct Level
+	{
+		uint32_t width, height;
+		std::vector<sf::Uint8> pixels;
+		sf::Texture texture;
+
+		TileRects pending_upload; // modified since the texture was last updated
+		TileRects pending_filter; // modified since the next level was last filtered from this one
+	};
+
+	std::vector<Level> levels_;
+	std::vector<sf::Uint8> upload_pixels_;
+
+	void mark_modified(uint32_t level, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+
+	// box filters the given rect of a level from the level before it
+	void filter_rect(uint32_t level, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+
+	// filters the modified areas of the levels before last_level into the levels after them, up to last_level
+	void update_levels(uint32_t last_level);
+
+public:
+	static const uint32_t MAX_LEVEL_COUNT = 6;
+
+	// a layer that's only ever shaded into and read back from needs no levels past the first
+	BlockLayer(uint32_t width, uint32_t height, uint32_t max_level_count = MAX_LEVEL_COUNT);
+	~BlockLayer();
+
+	// per-cell color noise is derived from the cell's position and the world seed rather than stored
+	static inline sf::Uint8 get_color_noise(uint32_t x, uint32_t y, unsigned int seed)
+	{
+		return static_cast<sf::Uint8>(Block::MIN_COLOR_NOISE + (Helper::hash_coords(x, y, seed) % (Block::MAX_COLOR_NOISE - Block::MIN_COLOR_NOISE + 1)));
+	}
+
+	/**
+	 * Writes the RGBA colors of count cells of a row, starting at (x, y), to out - the same colors as Block::get_block_color(),
+	 * except that the flicker of FireFX cells comes from a hash of their position and the seed. Colors before noise come from
+	 * a lookup table of every type and health, and the noise is then applied 4 pixels at a time. Safe to call from any thread.
+	 */
+	static void shade_row(const BlockType* types, const uint16_t* healths, uint32_t x, uint32_t y, uint32_t count, unsigned int seed, sf::Uint8* out);
+
+	// makes every pixel of every level transparent
+	void clear();
+
+	// reshades the cells in [x_begin, x_end) x [y_begin, y_end)
+	void shade_rect(const BlockGrid& blocks, unsigned int seed, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+
+	/**
+	 * Same as shade_rect(), but without marking the pixels as modified - mark_shaded() must be called for the rect afterwards.
+	 * Only touches the pixels of the rect, so disjoint rects can be shaded from several threads at once.
+	 */
+	void shade_rect_pixels(const BlockGrid& blocks, unsigned int seed, uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+	void mark_shaded(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+
+	// copies tightly packed RGBA rows into [x_begin, x_end) x [y_begin, y_end) of the first level, which must be within it
+	void write_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end, const sf::Uint8* pixels);
+
+	/**
+	 * Calls func(x_begin, y_begin, x_end, y_end) for the bounding rect of the pixels of the first level modified within each
+	 * tile since the last call (or upload of the first level), so that they can be copied to another layer.
+	 */
+	template <typename Func>
+	void consume_modified(Func func);
+
+	// brings the level up to date with the cells shaded so far and uploads its modified pixels to its texture
+	void upload(uint32_t level = 0);
+
+	/**
+	 * Returns the coarsest level whose pixels are no larger than an output pixel, given how many output pixels a cell covers.
+	 * Drawing anything finer than that would skip over cells when rasterized, and anything coarser would blur.
+	 */
+	uint32_t get_level_for_scale(float pixels_per_cell) const;
+
+	inline uint32_t get_level_count() const { return static_cast<uint32_t>(levels_.size()); }
+
+	inline const sf::Texture& get_texture(uint32_t level = 0) const { return levels_[level].texture; }
+	inline const sf::Uint8* get_pixels(uint32_t level = 0) const { return levels_[level].pixels.data(); }
+
+	inline uint32_t get_width(uint32_t level = 0) const { return levels_[level].width; }
+	inline uint32_t get_height(uint32_t level = 0) const { return levels_[level].height; }
+};
+
+template <typename Func>
+void BlockLayer::consume_modified(Func func)
+{
+	levels_[0].pending_upload.consume([&func](const TileRect& rect) {
+		func(rect.x_begin, rect.y_begin, rect.x_end, rect.y_end);
+	});
+}
+
+template <typename Func>
+void BlockLayer::TileRects::consume(Func func)
+{
+	for (const auto tile_index : tiles_) {
+		auto& rect = rects_[tile_index];
+		func(rect);
+		rect = TileRect{ 0, 0, 0, 0 };
+	}
+
+	tiles_.clear();
+}
@@ -0,0 +1,37 @@
+#include "BlockUpdateScheduler.h"
+
+#include <algorithm>
+
+
+BlockUpdateScheduler::BlockUpdateScheduler(uint32_t width, uint32_t height) :
+	cells_(width, height),
+	backlog_peak_latency_(sf::Time::Zero)
+{
+	tile_mark_times_.resize(static_cast<std::size_t>(cells_.get_tiles_width()) * cells_.get_tiles_height(), 0);
+}
+
+
+BlockUpdateScheduler::~BlockUpdateScheduler()
+{
+}
+
+
+void BlockUpdateScheduler::mark_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end)
+{
+	if (x_begin >= x_end || y_begin >= y_end)
+		return;
+
+	for (uint32_t tile_y = y_begin >> BlockChunk::SIZE_SHIFT; tile_y <= ((y_end - 1) >> BlockChunk::SIZE_SHIFT) && tile_y < cells_.get_tiles_height(); ++tile_y) {
+		for (uint32_t tile_x = x_begin >> BlockChunk::SIZE_SHIFT; tile_x <= ((x_end - 1) >> BlockChunk::SIZE_SHIFT) && tile_x < cells_.get_tiles_width(); ++tile_x)
+			stamp_tile(tile_x + (cells_.get_tiles_width() * tile_y));
+	}
+
+	cells_.mark_rect(x_begin, y_begin, x_end, y_end);
+}
+
+
+void BlockUpdateScheduler::clear()
+{
+	cells_.clear();
+	backlog_peak_latency_ = sf::Time::Zero;
+}
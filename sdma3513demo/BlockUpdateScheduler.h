@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <SFML/System/Clock.hpp>
+
+#include "BlockDirtyMap.h"
+
+/**
+ * Schedules the updates of marked cells against a time budget rather than a cell count.
+ *
+ * Marked cells are grouped into the tiles of a BlockDirtyMap, each remembering when it was first marked. Every update, tiles
+ * are drained whole in order of priority - their age, plus a bonus for being inside the visible rect - until the budget runs
+ * out, so that a large backlog (after a big explosion, say) is spread over several frames instead of stalling one, while
+ * whatever is on screen catches up first and nothing waits forever.
+ */
+class BlockUpdateScheduler
+{
+	BlockDirtyMap cells_;
+	sf::Clock clock_;
+
+	// microseconds on clock_ at which each dirty tile was first marked
+	std::vector<sf::Int64> tile_mark_times_;
+
+	// scratch space for ordering dirty tiles by priority
+	std::vector<std::pair<sf::Int64, uint32_t>> tile_order_;
+
+	// the longest any tile of the current backlog waited to be drained - reset once a new backlog starts
+	sf::Time backlog_peak_latency_;
+
+	inline void stamp_tile(uint32_t tile_index)
+	{
+		if (!cells_.is_tile_dirty(tile_index)) {
+			if (cells_.is_empty())
+				backlog_peak_latency_ = sf::Time::Zero;
+
+			tile_mark_times_[tile_index] = clock_.getElapsedTime().asMicroseconds();
+		}
+	}
+
+public:
+	// how much older a tile outside of the visible rect must be to be updated before one inside of it
+	static const sf::Int64 VISIBLE_TILE_PRIORITY_US = 250000;
+
+	BlockUpdateScheduler(uint32_t width, uint32_t height);
+	~BlockUpdateScheduler();
+
+	inline void mark(uint32_t x, uint32_t y)
+	{
+		stamp_tile(cells_.get_tile_index_at(x, y));
+		cells_.mark(x, y);
+	}
+
+	inline void mark_tile_row(uint32_t tile_x, uint32_t y, uint64_t row_bits)
+	{
+		stamp_tile(cells_.get_tile_index_at(tile_x << BlockChunk::SIZE_SHIFT, y));
+		cells_.mark_tile_row(tile_x, y, row_bits);
+	}
+
+	void mark_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+
+	void clear();
+
+	inline bool is_empty() const { return cells_.is_empty(); }
+
+	/**
+	 * Calls func(x_begin, x_end, y) for every run of marked cells in the tiles drained, highest priority first, until budget
+	 * has elapsed. At least one tile is always drained. The visible rect is in cells.
+	 * Returns the amount of cells updated.
+	 */
+	template <typename Func>
+	uint32_t update(Func func, const sf::Time& budget, uint32_t visible_x_begin, uint32_t visible_y_begin, uint32_t visible_x_end, uint32_t visible_y_end);
+
+	/**
+	 * The longest any tile drained since the map was last empty had been waiting to be updated - once an update has drained
+	 * the last of them, this is how far the backlog lagged behind.
+	 */
+	inline sf::Time get_backlog_peak_latency() const { return backlog_peak_latency_; }
+};
+
+template <typename Func>
+uint32_t BlockUpdateScheduler::update(Func func, const sf::Time& budget,
+	uint32_t visible_x_begin, uint32_t visible_y_begin, uint32_t visible_x_end, uint32_t visible_y_end)
+{
+	if (cells_.is_empty())
+		return 0;
+
+	const auto visible_tile_x_begin = visible_x_begin >> BlockChunk::SIZE_SHIFT;
+	const auto visible_tile_y_begin = visible_y_begin >> BlockChunk::SIZE_SHIFT;
+	const auto visible_tile_x_end = (visible_x_end + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT;
+	const auto visible_tile_y_end = (visible_y_end + BlockChunk::SIZE_MASK) >> BlockChunk::SIZE_SHIFT;
+
+	const auto now = clock_.getElapsedTime().asMicroseconds();
+	tile_order_.clear();
+	for (const auto tile_index : cells_.get_dirty_tiles()) {
+		const auto tile_x = tile_index % cells_.get_tiles_width();
+		const auto tile_y = tile_index / cells_.get_tiles_width();
+		const bool visible = tile_x >= visible_tile_x_begin && tile_x < visible_tile_x_end && tile_y >= visible_tile_y_begin && tile_y < visible_tile_y_end;
+
+		tile_order_.emplace_back((now - tile_mark_times_[tile_index]) + (visible ? VISIBLE_TILE_PRIORITY_US : 0), tile_index);
+	}
+
+	// draining tiles shuffles the order they're listed in, so ties are broken by tile index to keep the order the same between runs
+	std::sort(tile_order_.begin(), tile_order_.end(), [](const std::pair<sf::Int64, uint32_t>& a, const std::pair<sf::Int64, uint32_t>& b) {
+		return a.first > b.first || (a.first == b.first && a.second < b.second);
+	});
+
+	const auto deadline = now + budget.asMicroseconds();
+	uint32_t updated_cells = 0;
+
+	for (std::size_t i = 0; i < tile_order_.size(); ++i) {
+		if (i > 0 && clock_.getElapsedTime().asMicroseconds() >= deadline)
+			break;
+
+		const auto tile_index = tile_order_[i].second;
+		const auto latency = sf::microseconds(now - tile_mark_times_[tile_index]);
+		if (latency > backlog_peak_latency_)
+			backlog_peak_latency_ = latency;
+
+		updated_cells += cells_.consume_tile(tile_index, func);
+	}
+
+	return updated_cells;
+}
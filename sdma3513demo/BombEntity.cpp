@@ -5,13 +5,13 @@
 
 #include "Constants.h"
 #include "World.h"
-#include "SmokeParticleEntity.h"
-#include "PlayerTurretEntity.h"
+#include "WorldCommandBuffer.h"
 #include "Helper.h"
+#include "RenderSnapshot.h"
 
 
 BombEntity::BombEntity() :
-	PhysicsEntity(),
+	PhysicsEntity(false, TYPE),
 	explosion_r_(100),
 	explosion_damage_(100),
 	player_id_for_scoring_(Entity::INVALID_ENTITY_ID)
@@ -27,45 +27,43 @@ BombEntity::~BombEntity()
 }
 
 
-void BombEntity::tick()
+void BombEntity::tick(WorldCommandBuffer& commands)
 {
 	smoke_time_ += Constants::FRAME_TIME;
 
 	auto world = get_world();
 	if (world) {
-		if (world->blocks_test_rectangle_collision(get_rectangle()).first) {
-			// we have a collision - explode!
-			const auto pos = sf::Vector2f(get_position().x + (0.5f * get_rectangle().width), get_position().y + (0.5f * get_rectangle().height));
-			world->explode_at(
+		// sweep over this tick's motion so fast bombs can't fall through thin ground
+		const auto block_hit = world->blocks_sweep_rectangle(get_rectangle(), get_velocity());
+		if (block_hit.block) {
+			// we have a collision - explode where we hit!
+			const auto hit_pos = get_position() + (block_hit.t * get_velocity());
+			const auto pos = sf::Vector2f(hit_pos.x + (0.5f * get_rectangle().width), hit_pos.y + (0.5f * get_rectangle().height));
+			commands.explode_at(
 				static_cast<uint32_t>(pos.x / Block::BLOCK_SIZE.x), static_cast<uint32_t>(pos.y / Block::BLOCK_SIZE.y),
 				explosion_r_, explosion_damage_
 			);
 
-			auto player = static_cast<PlayerTurretEntity*>(world->get_entity(player_id_for_scoring_));
-			if (player)
-				player->increment_player_bombs_missed();
-
-			mark_for_deletion();
+			commands.increment_player_bombs_missed(player_id_for_scoring_);
+			commands.remove_entity(get_id());
 		}
 		else if (get_position().y > static_cast<float>(Constants::VIDEO_HEIGHT))
-			mark_for_deletion();
+			commands.remove_entity(get_id());
 		else if (smoke_time_.asSeconds() > 0.4f) {
-			auto smoke = std::make_unique<SmokeParticleEntity>();
-			smoke->set_position(get_position() + sf::Vector2f(get_rectangle().width * 0.5f, -1.0f * get_rectangle().height));
-			world->add_entity(static_cast<std::unique_ptr<Entity>>(std::move(smoke)));
+			commands.emit_smoke(sf::FloatRect(get_position() + sf::Vector2f(get_rectangle().width * 0.5f, -1.0f * get_rectangle().height), sf::Vector2f(10.0f, 10.0f)));
 			smoke_time_ -= sf::seconds(0.4f);
 		}
 	}
 	
-	PhysicsEntity::tick();
+	PhysicsEntity::tick(commands);
 }
 
 
-void BombEntity::render(sf::RenderTarget& target)
+void BombEntity::render(sf::RenderTarget& target, const EntityRenderState& state, std::mt19937& rng)
 {
 	sf::CircleShape bomb(0.5f);
-	bomb.setScale(sf::Vector2f(get_rectangle().width, get_rectangle().height));
-	bomb.setFillColor(sf::Color(255, Helper::get_random_int(0, 185), 0));
-	bomb.setPosition(get_position());
+	bomb.setScale(state.size);
+	bomb.setFillColor(sf::Color(255, Helper::get_random_int(rng, 0, 185), 0));
+	bomb.setPosition(state.position);
 	target.draw(bomb);
 }
\ No newline at end of file
@@ -7,6 +7,12 @@ namespace Constants
 	const unsigned int VIDEO_WIDTH = 1024;
 	const unsigned int VIDEO_HEIGHT = 576;
 
+	// rate the game ticks at - frames are drawn in between ticks, up to MAX_RENDER_FRAME_RATE
 	const unsigned int FRAME_RATE = 30;
 	const auto FRAME_TIME = sf::seconds(1.0f / FRAME_RATE);
+
+	const unsigned int MAX_RENDER_FRAME_RATE = 144;
+
+	// how far the game may fall behind its ticks before giving up on catching up
+	const auto MAX_TICK_LAG = FRAME_TIME * 4.0f;
 }
\ No newline at end of file
@@ -1,10 +1,14 @@
 #include "Entity.h"
 
+#include "RenderSnapshot.h"
 
 
-Entity::Entity(bool fx_only) :
+
+Entity::Entity(bool fx_only, EntityType type, EntityCapabilityMask capabilities) :
 	id_(INVALID_ENTITY_ID),
 	world_(nullptr),
+	type_(type),
+	capabilities_(capabilities),
 	marked_for_deletion_(false),
 	is_fx_only_(fx_only)
 {
@@ -13,4 +17,32 @@ Entity::Entity(bool fx_only) :
 
 Entity::~Entity()
 {
-}
\ No newline at end of file
+}
+
+
+void Entity::get_render_state(EntityRenderState& state) const
+{
+	state.id = id_;
+	state.type = type_;
+	state.position = sf::Vector2f();
+	state.size = sf::Vector2f();
+	state.angle = 0.0f;
+}
+
+
+const char* Entity::get_type_name(EntityType type)
+{
+	switch (type) {
+	case EntityType::PlayerTurret:
+		return "PlayerTurretEntity";
+
+	case EntityType::PlayerMissile:
+		return "PlayerMissileEntity";
+
+	case EntityType::Bomb:
+		return "BombEntity";
+
+	default:
+		return "Entity";
+	}
+}
@@ -1,12 +1,35 @@
 #pragma once
 
 #include <cstdint>
-#include <string>
+
+#include <random>
 
 #include <SFML/Graphics/RenderTarget.hpp>
 
+// slot index in the low 32 bits and its generation in the high 32 bits - see EntitySlotMap
 typedef uint64_t EntityId;
 
+// concrete type of an entity, given by the TYPE constant of its class - see entity_cast()
+enum class EntityType : uint8_t
+{
+	Other,
+	PlayerTurret,
+	PlayerMissile,
+	Bomb
+};
+
+// bitmask of EntityTypes, where bit n is set for the EntityType with a value of n
+typedef uint32_t EntityTypeMask;
+
+// what an entity can do regardless of its type, for casting to the base classes that provide it
+enum class EntityCapability : uint8_t
+{
+	Physics // is a PhysicsEntity
+};
+
+// bitmask of EntityCapabilities, where bit n is set for the EntityCapability with a value of n
+typedef uint32_t EntityCapabilityMask;
+
 class IRectangle
 {
 public:
@@ -22,11 +45,15 @@ public:
 };
 
 class World;
+class WorldCommandBuffer;
+struct EntityRenderState;
 
 class Entity
 {
 	EntityId id_;
 	World* world_;
+	EntityType type_;
+	EntityCapabilityMask capabilities_;
 	bool is_fx_only_;
 	bool marked_for_deletion_;
 
@@ -34,22 +61,60 @@ public:
 	// invalid ent id - should wrap around to max val of EntityId if unsigned
 	static const EntityId INVALID_ENTITY_ID = -1;
 
-	Entity(bool fx_only);
+	static const EntityType TYPE = EntityType::Other;
+
+	static const EntityTypeMask ENTITY_TYPE_MASK_ALL = ~static_cast<EntityTypeMask>(0);
+	static inline EntityTypeMask get_type_mask(EntityType type) { return 1U << static_cast<uint32_t>(type); }
+	static inline EntityCapabilityMask get_capability_mask(EntityCapability capability) { return 1U << static_cast<uint32_t>(capability); }
+
+	static const char* get_type_name(EntityType type);
+
+	// every entity is an Entity
+	static inline bool is_instance(const Entity&) { return true; }
+
+	Entity(bool fx_only, EntityType type = TYPE, EntityCapabilityMask capabilities = 0);
 	virtual ~Entity();
 
 	inline void assign_world(World* world, EntityId id) { world_ = world; id_ = id; }
 
-	inline virtual void tick() { }
-	inline virtual void render(sf::RenderTarget& target) { }
+	/**
+	 * Entities only change their own state while ticking - effects on the rest of the world go through commands, as other
+	 * entities may be ticking on other threads at the same time. See WorldCommandBuffer.
+	 */
+	inline virtual void tick(WorldCommandBuffer&) { }
+
+	/**
+	 * Describes how the entity looks as of the end of the tick, to be drawn on the render thread by the static render() of
+	 * its class - so nothing it draws may be read from the entity itself. See Renderer.
+	 */
+	virtual void get_render_state(EntityRenderState& state) const;
 
 	inline void mark_for_deletion() { marked_for_deletion_ = true; }
 	inline bool is_marked_for_deletion() const { return marked_for_deletion_; }
 
 	inline EntityId get_id() const { return id_; }
-	virtual std::string get_name() const = 0;
+	inline const char* get_name() const { return get_type_name(type_); }
 
 	inline bool is_fx_only() const { return is_fx_only_; }
+	inline EntityType get_type() const { return type_; }
+	inline bool has_capability(EntityCapability capability) const { return (capabilities_ & get_capability_mask(capability)) != 0; }
 
 	inline World* get_world() { return world_; }
 };
 
+/**
+ * Returns the entity as a T, or null if it isn't one (or is null), without RTTI.
+ * Every entity class defines a static is_instance(): concrete classes compare the entity's type with their TYPE, and base
+ * classes check for the capability they provide, so the check is a single integer compare either way.
+ */
+template <typename T>
+inline T* entity_cast(Entity* entity)
+{
+	return entity && T::is_instance(*entity) ? static_cast<T*>(entity) : nullptr;
+}
+
+template <typename T>
+inline const T* entity_cast(const Entity* entity)
+{
+	return entity && T::is_instance(*entity) ? static_cast<const T*>(entity) : nullptr;
+}
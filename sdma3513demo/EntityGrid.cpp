@@ -0,0 +1,117 @@
+#include "EntityGrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+EntityGrid::EntityGrid(float width, float height, float cell_size) :
+	cell_size_(cell_size),
+	width_(std::max(static_cast<uint32_t>(std::ceil(width / cell_size)), 1U)),
+	height_(std::max(static_cast<uint32_t>(std::ceil(height / cell_size)), 1U))
+{
+	cells_.resize(static_cast<std::size_t>(width_) * height_);
+}
+
+
+EntityGrid::~EntityGrid()
+{
+}
+
+
+EntityGrid::CellSpan EntityGrid::get_cell_span(const sf::FloatRect& rect) const
+{
+	// same as sf::Rect::intersects(), rectangles with -ve widths or heights are allowed
+	const float left = std::min(rect.left, rect.left + rect.width);
+	const float top = std::min(rect.top, rect.top + rect.height);
+	const float right = std::max(rect.left, rect.left + rect.width);
+	const float bottom = std::max(rect.top, rect.top + rect.height);
+
+	const auto to_cell = [this](float pos, uint32_t cell_count) {
+		return static_cast<uint32_t>(std::max(0.0f, std::min(std::floor(pos / cell_size_), static_cast<float>(cell_count - 1))));
+	};
+
+	return CellSpan{ to_cell(left, width_), to_cell(top, height_), to_cell(right, width_) + 1, to_cell(bottom, height_) + 1 };
+}
+
+
+void EntityGrid::add_to_cells(uint32_t entry_index, const CellSpan& span)
+{
+	for (uint32_t y = span.y_begin; y < span.y_end; ++y) {
+		for (uint32_t x = span.x_begin; x < span.x_end; ++x)
+			cells_[x + (width_ * y)].push_back(entry_index);
+	}
+}
+
+
+void EntityGrid::remove_from_cells(uint32_t entry_index, const CellSpan& span)
+{
+	for (uint32_t y = span.y_begin; y < span.y_end; ++y) {
+		for (uint32_t x = span.x_begin; x < span.x_end; ++x) {
+			auto& cell = cells_[x + (width_ * y)];
+			const auto it = std::find(cell.begin(), cell.end(), entry_index);
+			if (it != cell.end()) {
+				*it = cell.back();
+				cell.pop_back();
+			}
+		}
+	}
+}
+
+
+void EntityGrid::update(Entity* entity)
+{
+	const auto entry_index = static_cast<uint32_t>(entity->get_id());
+	if (entry_index >= entries_.size())
+		entries_.resize(entry_index + 1, Entry{ nullptr, nullptr, sf::FloatRect(), CellSpan{ 0, 0, 0, 0 } });
+
+	auto& entry = entries_[entry_index];
+	if (entry.entity != entity) {
+		// entities without a rectangle can't collide with anything
+		const auto physics = entity_cast<PhysicsEntity>(entity);
+		if (!physics)
+			return;
+
+		if (entry.entity)
+			remove_from_cells(entry_index, entry.span);
+
+		entry.entity = entity;
+		entry.physics = physics;
+		entry.rect = physics->get_rectangle();
+		entry.span = get_cell_span(entry.rect);
+		add_to_cells(entry_index, entry.span);
+		return;
+	}
+
+	entry.rect = entry.physics->get_rectangle();
+	const auto span = get_cell_span(entry.rect);
+	if (span.x_begin != entry.span.x_begin || span.y_begin != entry.span.y_begin || span.x_end != entry.span.x_end || span.y_end != entry.span.y_end) {
+		remove_from_cells(entry_index, entry.span);
+		entry.span = span;
+		add_to_cells(entry_index, entry.span);
+	}
+}
+
+
+void EntityGrid::remove(Entity* entity)
+{
+	const auto entry_index = static_cast<uint32_t>(entity->get_id());
+	if (entry_index >= entries_.size() || entries_[entry_index].entity != entity)
+		return;
+
+	auto& entry = entries_[entry_index];
+	remove_from_cells(entry_index, entry.span);
+	entry.entity = nullptr;
+	entry.physics = nullptr;
+}
+
+
+void EntityGrid::clear()
+{
+	for (auto& cell : cells_)
+		cell.clear();
+
+	for (auto& entry : entries_) {
+		entry.entity = nullptr;
+		entry.physics = nullptr;
+	}
+}
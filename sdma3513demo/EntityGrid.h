@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include <SFML/Graphics/Rect.hpp>
+
+#include "PhysicsEntity.h"
+
+/**
+ * Uniform grid broadphase over the rectangles of entities.
+ *
+ * Entities are tracked by the slot index of their EntityId and listed in every cell their rectangle touches (positions outside
+ * of the grid are clamped to its border cells). update() only moves an entity between cells when the span of cells it covers
+ * changes, and the live rectangles are tested again in the narrowphase, so queries are exact as long as an entity is updated
+ * after it moves.
+ */
+class EntityGrid
+{
+	struct CellSpan
+	{
+		uint32_t x_begin, y_begin, x_end, y_end;
+	};
+
+	struct Entry
+	{
+		Entity* entity; // null if not in the grid
+		PhysicsEntity* physics;
+		sf::FloatRect rect; // as of the last update
+		CellSpan span;
+	};
+
+	float cell_size_;
+	uint32_t width_, height_;
+
+	std::vector<std::vector<uint32_t>> cells_;
+	std::vector<Entry> entries_; // indexed by the slot index of the entity's ID
+
+	CellSpan get_cell_span(const sf::FloatRect& rect) const;
+
+	void add_to_cells(uint32_t entry_index, const CellSpan& span);
+	void remove_from_cells(uint32_t entry_index, const CellSpan& span);
+
+public:
+	EntityGrid(float width, float height, float cell_size);
+	~EntityGrid();
+
+	// adds the entity if it isn't in the grid yet, or moves it to the cells its rectangle now covers
+	void update(Entity* entity);
+	void remove(Entity* entity);
+	void clear();
+
+	/**
+	 * Calls func(entity, entity_rect) for every entity in the grid whose type is in the mask and whose rectangle intersects rect,
+	 * except for the entity with exclude_id. Stops early if func returns false.
+	 * Rectangles are the ones the entities had when they were last updated. Queries don't modify the grid, so any amount of
+	 * them can run at once as long as nothing is updated meanwhile.
+	 */
+	template <typename Func>
+	void query(const sf::FloatRect& rect, EntityTypeMask type_mask, EntityId exclude_id, Func func) const;
+};
+
+template <typename Func>
+void EntityGrid::query(const sf::FloatRect& rect, EntityTypeMask type_mask, EntityId exclude_id, Func func) const
+{
+	const auto span = get_cell_span(rect);
+	for (uint32_t y = span.y_begin; y < span.y_end; ++y) {
+		for (uint32_t x = span.x_begin; x < span.x_end; ++x) {
+			for (const auto entry_index : cells_[x + (width_ * y)]) {
+				// entities spanning multiple cells are only visited in the first cell that they share with the query
+				const auto& entry = entries_[entry_index];
+				if (x != std::max(entry.span.x_begin, span.x_begin) || y != std::max(entry.span.y_begin, span.y_begin))
+					continue;
+
+				if (!(Entity::get_type_mask(entry.entity->get_type()) & type_mask) || entry.entity->get_id() == exclude_id)
+					continue;
+
+				if (rect.intersects(entry.rect) && !func(entry.entity, entry.rect))
+					return;
+			}
+		}
+	}
+}
@@ -0,0 +1,91 @@
+#include "EntityPool.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include "Entity.h"
+
+
+void EntityPool::Deleter::operator()(Entity* entity) const
+{
+	// the slot starts at the most derived object, which isn't necessarily where its Entity base is
+	void* const slot = dynamic_cast<void*>(entity);
+	entity->~Entity();
+	pool->deallocate(slot);
+}
+
+
+EntityPool::EntityPool(std::size_t object_size, std::size_t slots_per_page) :
+	slots_per_page_(slots_per_page),
+	free_list_(nullptr),
+	allocated_count_(0)
+{
+	// new[] only guarantees the fundamental alignment, which is all entities need
+	const std::size_t alignment = alignof(std::max_align_t);
+	slot_size_ = ((std::max(object_size, sizeof(void*)) + alignment - 1) / alignment) * alignment;
+}
+
+
+EntityPool::~EntityPool()
+{
+	assert(allocated_count_ == 0 && "entity pool destroyed with entities still alive!");
+}
+
+
+void EntityPool::add_page()
+{
+	pages_.emplace_back(new unsigned char[slot_size_ * slots_per_page_]);
+	const auto page = pages_.back().get();
+
+	// thread the new slots onto the front of the free list in address order
+	for (std::size_t i = slots_per_page_; i-- > 0;) {
+		void* const slot = page + (i * slot_size_);
+		std::memcpy(slot, &free_list_, sizeof(free_list_));
+		free_list_ = slot;
+	}
+}
+
+
+void* EntityPool::allocate()
+{
+	if (!free_list_)
+		add_page();
+
+	void* const slot = free_list_;
+	std::memcpy(&free_list_, slot, sizeof(free_list_));
+	++allocated_count_;
+	return slot;
+}
+
+
+void EntityPool::deallocate(void* slot)
+{
+	assert(allocated_count_ > 0);
+	std::memcpy(slot, &free_list_, sizeof(free_list_));
+	free_list_ = slot;
+	--allocated_count_;
+}
+
+
+void EntityPool::reset()
+{
+	assert(allocated_count_ == 0 && "entity pool reset with entities still alive!");
+	free_list_ = nullptr;
+
+	for (std::size_t p = pages_.size(); p-- > 0;) {
+		const auto page = pages_[p].get();
+		for (std::size_t i = slots_per_page_; i-- > 0;) {
+			void* const slot = page + (i * slot_size_);
+			std::memcpy(slot, &free_list_, sizeof(free_list_));
+			free_list_ = slot;
+		}
+	}
+}
+
+
+std::size_t EntityPool::get_next_type_index()
+{
+	static std::size_t next_type_index = 0;
+	return next_type_index++;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+class Entity;
+
+/**
+ * Fixed-size slots for entities of one type, carved out of pages that are kept around once allocated so that spawning and
+ * removing entities in the steady state never touches the heap. Free slots are kept on an intrusive list.
+ */
+class EntityPool
+{
+	std::size_t slot_size_;
+	std::size_t slots_per_page_;
+	std::vector<std::unique_ptr<unsigned char[]>> pages_;
+
+	void* free_list_;
+	std::size_t allocated_count_;
+
+	void add_page();
+
+public:
+	// destroys an entity and gives its slot back to the pool it came from
+	struct Deleter
+	{
+		EntityPool* pool;
+		void operator()(Entity* entity) const;
+	};
+
+	EntityPool(std::size_t object_size, std::size_t slots_per_page = 256);
+	~EntityPool();
+
+	EntityPool(const EntityPool&) = delete;
+	EntityPool& operator=(const EntityPool&) = delete;
+
+	void* allocate();
+	void deallocate(void* slot);
+
+	/**
+	 * Frees every slot at once, so that the next allocations are contiguous again. The pages themselves are kept.
+	 * Every entity allocated from the pool must have been destroyed before.
+	 */
+	void reset();
+
+	inline std::size_t get_allocated_count() const { return allocated_count_; }
+	inline std::size_t get_capacity() const { return pages_.size() * slots_per_page_; }
+
+	// each entity type gets its own index for looking up its pool
+	static std::size_t get_next_type_index();
+};
+
+typedef std::unique_ptr<Entity, EntityPool::Deleter> PooledEntityPtr;
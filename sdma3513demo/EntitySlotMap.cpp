@@ -0,0 +1,98 @@
+#include "EntitySlotMap.h"
+
+#include <cassert>
+
+
+EntitySlotMap::EntitySlotMap()
+{
+}
+
+
+EntitySlotMap::~EntitySlotMap()
+{
+}
+
+
+EntityId EntitySlotMap::insert(PooledEntityPtr entity)
+{
+	uint32_t slot_index;
+	if (!free_slots_.empty()) {
+		slot_index = free_slots_.back();
+		free_slots_.pop_back();
+	}
+	else {
+		slot_index = static_cast<uint32_t>(slots_.size());
+		slots_.push_back(Slot{ 0, INVALID_INDEX, INVALID_INDEX });
+	}
+
+	auto& slot = slots_[slot_index];
+	slot.dense_index = static_cast<uint32_t>(entities_.size());
+
+	if (!entity->is_fx_only()) {
+		slot.non_fx_index = static_cast<uint32_t>(non_fx_entities_.size());
+		non_fx_entities_.push_back(entity.get());
+		non_fx_slots_.push_back(slot_index);
+	}
+
+	entities_.push_back(std::move(entity));
+	entity_slots_.push_back(slot_index);
+	return make_id(slot_index, slot.generation);
+}
+
+
+bool EntitySlotMap::remove(EntityId id)
+{
+	const auto slot = get_slot(id);
+	if (!slot)
+		return false;
+
+	remove_at(slot->dense_index);
+	return true;
+}
+
+
+void EntitySlotMap::remove_at(std::size_t index)
+{
+	assert(index < entities_.size());
+	const auto slot_index = entity_slots_[index];
+	auto& slot = slots_[slot_index];
+
+	// swap and pop, pointing the slots of the moved entities at their new places
+	if (slot.non_fx_index != INVALID_INDEX) {
+		const auto moved_slot_index = non_fx_slots_.back();
+		non_fx_entities_[slot.non_fx_index] = non_fx_entities_.back();
+		non_fx_slots_[slot.non_fx_index] = moved_slot_index;
+		slots_[moved_slot_index].non_fx_index = slot.non_fx_index;
+		non_fx_entities_.pop_back();
+		non_fx_slots_.pop_back();
+	}
+
+	const auto moved_slot_index = entity_slots_.back();
+	entities_[index] = std::move(entities_.back());
+	entity_slots_[index] = moved_slot_index;
+	slots_[moved_slot_index].dense_index = static_cast<uint32_t>(index);
+	entities_.pop_back();
+	entity_slots_.pop_back();
+
+	slot.dense_index = INVALID_INDEX;
+	slot.non_fx_index = INVALID_INDEX;
+	++slot.generation;
+	free_slots_.push_back(slot_index);
+}
+
+
+void EntitySlotMap::clear()
+{
+	for (const auto slot_index : entity_slots_) {
+		auto& slot = slots_[slot_index];
+		slot.dense_index = INVALID_INDEX;
+		slot.non_fx_index = INVALID_INDEX;
+		++slot.generation;
+		free_slots_.push_back(slot_index);
+	}
+
+	entities_.clear();
+	entity_slots_.clear();
+	non_fx_entities_.clear();
+	non_fx_slots_.clear();
+}
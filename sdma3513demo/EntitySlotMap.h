@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Entity.h"
+#include "EntityPool.h"
+
+/**
+ * Dense storage of entities addressed by generation-checked handles.
+ *
+ * An EntityId is the index of a slot in its low 32 bits and the generation of that slot in its high 32 bits. Removing an
+ * entity bumps its slot's generation so that stale IDs stop resolving, and the slot is reused by the next insertion.
+ * Entities themselves are kept contiguous (and iterated in a stable order) by moving the last one into the place of a removed
+ * one. Entities that aren't fx-only are also listed separately, with their slots pointing back to their place in that list
+ * so that they can be removed from it in constant time too.
+ */
+class EntitySlotMap
+{
+	static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+	struct Slot
+	{
+		uint32_t generation;
+		uint32_t dense_index; // INVALID_INDEX if free
+		uint32_t non_fx_index; // INVALID_INDEX if fx-only or free
+	};
+
+	std::vector<Slot> slots_;
+	std::vector<uint32_t> free_slots_;
+
+	std::vector<PooledEntityPtr> entities_;
+	std::vector<uint32_t> entity_slots_; // slot index of each entity in entities_
+	std::vector<Entity*> non_fx_entities_;
+	std::vector<uint32_t> non_fx_slots_; // slot index of each entity in non_fx_entities_
+
+	static inline uint32_t get_slot_index(EntityId id) { return static_cast<uint32_t>(id); }
+	static inline uint32_t get_generation(EntityId id) { return static_cast<uint32_t>(id >> 32); }
+	static inline EntityId make_id(uint32_t slot_index, uint32_t generation) { return (static_cast<EntityId>(generation) << 32) | slot_index; }
+
+	inline const Slot* get_slot(EntityId id) const
+	{
+		const auto slot_index = get_slot_index(id);
+		if (slot_index >= slots_.size())
+			return nullptr;
+
+		const auto& slot = slots_[slot_index];
+		return slot.generation == get_generation(id) && slot.dense_index != INVALID_INDEX ? &slot : nullptr;
+	}
+
+public:
+	EntitySlotMap();
+	~EntitySlotMap();
+
+	// returns the ID the entity is stored under - the entity isn't told about it
+	EntityId insert(PooledEntityPtr entity);
+
+	inline Entity* get(EntityId id) const
+	{
+		const auto slot = get_slot(id);
+		return slot ? entities_[slot->dense_index].get() : nullptr;
+	}
+
+	// returns false if no entity is stored under the ID
+	bool remove(EntityId id);
+
+	// removes the entity at the given position of iteration, replacing it with the last one
+	void remove_at(std::size_t index);
+
+	// removes every entity - IDs given out before remain invalid afterwards
+	void clear();
+
+	inline std::size_t size() const { return entities_.size(); }
+	inline Entity* get_at(std::size_t index) const { return entities_[index].get(); }
+
+	inline const std::vector<Entity*>& get_non_fx_entities() const { return non_fx_entities_; }
+};
@@ -0,0 +1,183 @@
+#include "ExplosionQueue.h"
+
+#include <limits>
+#include <algorithm>
+
+#include "Helper.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define EXPLOSION_QUEUE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+	// bounding square of a blast, clamped to the world
+	struct BlastBounds
+	{
+		uint32_t x_begin, y_begin, x_end, y_end;
+
+		BlastBounds(const ExplosionRequest& request, uint32_t width, uint32_t height) :
+			x_begin(static_cast<uint32_t>(std::max(static_cast<int64_t>(request.x) - request.r, static_cast<int64_t>(0)))),
+			y_begin(static_cast<uint32_t>(std::max(static_cast<int64_t>(request.y) - request.r, static_cast<int64_t>(0)))),
+			x_end(static_cast<uint32_t>(std::min(static_cast<int64_t>(request.x) + request.r + 1, static_cast<int64_t>(width)))),
+			y_end(static_cast<uint32_t>(std::min(static_cast<int64_t>(request.y) + request.r + 1, static_cast<int64_t>(height))))
+		{
+		}
+
+		inline bool intersects(const BlastBounds& other) const
+		{
+			return x_begin < other.x_end && other.x_begin < x_end && y_begin < other.y_end && other.y_begin < y_end;
+		}
+	};
+
+	// dst[i] = min(dst[i] + src[i], 0xFFFF)
+	void add_damages(uint16_t* dst, const uint16_t* src, uint32_t count)
+	{
+		uint32_t i = 0;
+
+#ifdef EXPLOSION_QUEUE_USE_SSE2
+		for (; i + 8 <= count; i += 8) {
+			const auto sum = _mm_adds_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sum);
+		}
+#endif
+
+		for (; i < count; ++i)
+			dst[i] = static_cast<uint16_t>(std::min(static_cast<uint32_t>(dst[i]) + src[i], static_cast<uint32_t>(0xFFFF)));
+	}
+}
+
+
+ExplosionQueue::ExplosionQueue()
+{
+}
+
+
+ExplosionQueue::~ExplosionQueue()
+{
+}
+
+
+const ExplosionStencil& ExplosionQueue::get_stencil(uint16_t r, uint32_t center_damage)
+{
+	for (auto it = stencils_.begin(); it != stencils_.end(); ++it) {
+		if ((*it)->get_radius() == r && (*it)->get_center_damage() == center_damage) {
+			// move to the back as the most recently used
+			std::rotate(it, it + 1, stencils_.end());
+			return *stencils_.back();
+		}
+	}
+
+	if (stencils_.size() >= MAX_CACHED_STENCILS)
+		stencils_.erase(stencils_.begin());
+
+	stencils_.push_back(std::make_unique<ExplosionStencil>(r, center_damage));
+	return *stencils_.back();
+}
+
+
+uint32_t ExplosionQueue::find_group(uint32_t request_index)
+{
+	while (request_groups_[request_index] != request_index) {
+		// path halving
+		request_groups_[request_index] = request_groups_[request_groups_[request_index]];
+		request_index = request_groups_[request_index];
+	}
+
+	return request_index;
+}
+
+
+std::size_t ExplosionQueue::group_requests(uint32_t width, uint32_t height)
+{
+	const auto request_count = static_cast<uint32_t>(requests_.size());
+
+	request_groups_.resize(request_count);
+	for (uint32_t i = 0; i < request_count; ++i)
+		request_groups_[i] = i;
+
+	// there are only ever a handful of explosions per tick, so testing every pair is cheap
+	for (uint32_t i = 0; i < request_count; ++i) {
+		const BlastBounds bounds(requests_[i], width, height);
+		for (uint32_t j = i + 1; j < request_count; ++j) {
+			if (bounds.intersects(BlastBounds(requests_[j], width, height)))
+				request_groups_[find_group(j)] = find_group(i);
+		}
+	}
+
+	grouped_requests_.resize(request_count);
+	for (uint32_t i = 0; i < request_count; ++i) {
+		request_groups_[i] = find_group(i);
+		grouped_requests_[i] = i;
+	}
+
+	// order of requests within a group is kept, so the result doesn't depend on the sort
+	std::stable_sort(grouped_requests_.begin(), grouped_requests_.end(), [this](uint32_t a, uint32_t b) { return request_groups_[a] < request_groups_[b]; });
+
+	group_starts_.clear();
+	for (uint32_t i = 0; i < request_count; ++i) {
+		if (i == 0 || request_groups_[grouped_requests_[i]] != request_groups_[grouped_requests_[i - 1]])
+			group_starts_.push_back(i);
+	}
+
+	const auto group_count = group_starts_.size();
+	group_starts_.push_back(request_count);
+	return group_count;
+}
+
+
+void ExplosionQueue::build_region(std::size_t group, uint32_t width, uint32_t height)
+{
+	const auto group_begin = grouped_requests_.begin() + group_starts_[group];
+	const auto group_end = grouped_requests_.begin() + group_starts_[group + 1];
+
+	// bounds of the blasts, widened to whole words
+	region_.x_begin = region_.y_begin = std::numeric_limits<uint32_t>::max();
+	region_.x_end = region_.y_end = 0;
+	region_.gib_chance = 0.0;
+	for (auto it = group_begin; it != group_end; ++it) {
+		const auto& request = requests_[*it];
+		const BlastBounds bounds(request, width, height);
+
+		region_.x_begin = std::min(region_.x_begin, bounds.x_begin & ~BlockChunk::SIZE_MASK);
+		region_.y_begin = std::min(region_.y_begin, bounds.y_begin);
+		region_.x_end = std::max(region_.x_end, (bounds.x_end + BlockChunk::SIZE_MASK) & ~BlockChunk::SIZE_MASK);
+		region_.y_end = std::max(region_.y_end, bounds.y_end);
+		region_.gib_chance = std::max(region_.gib_chance, request.gib_chance);
+	}
+
+	const auto words_width = region_.get_words_width();
+	const auto word_count = static_cast<std::size_t>(words_width) * (region_.y_end - region_.y_begin);
+	region_.damages.assign(word_count << BlockChunk::SIZE_SHIFT, 0);
+	region_.covered_rows.assign(word_count, 0);
+
+	// sum up the chords of every blast
+	for (auto it = group_begin; it != group_end; ++it) {
+		const auto& request = requests_[*it];
+		const auto& stencil = get_stencil(request.r, request.center_damage);
+		const BlastBounds bounds(request, width, height);
+
+		for (uint32_t y = bounds.y_begin; y < bounds.y_end; ++y) {
+			const auto dy = static_cast<int32_t>(static_cast<int64_t>(y) - request.y);
+			const auto half_width = stencil.get_half_width(dy);
+			const int64_t row_start_x = static_cast<int64_t>(request.x) - half_width;
+			if (row_start_x >= static_cast<int64_t>(width))
+				continue;
+
+			const uint32_t start_x = static_cast<uint32_t>(std::max(row_start_x, static_cast<int64_t>(0)));
+			const uint32_t end_x = static_cast<uint32_t>(std::min(static_cast<int64_t>(request.x) + half_width + 1, static_cast<int64_t>(width)));
+
+			const auto row_index = region_.get_word_index(0, y);
+			add_damages(region_.damages.data() + (row_index << BlockChunk::SIZE_SHIFT) + (start_x - region_.x_begin),
+				stencil.get_row_damages(dy) + (start_x - row_start_x), end_x - start_x);
+
+			for (uint32_t word_x = (start_x - region_.x_begin) >> BlockChunk::SIZE_SHIFT; (word_x << BlockChunk::SIZE_SHIFT) < end_x - region_.x_begin; ++word_x) {
+				const auto word_base_x = region_.x_begin + (word_x << BlockChunk::SIZE_SHIFT);
+				region_.covered_rows[row_index + word_x] |= Helper::get_bit_range_mask(std::max(start_x, word_base_x) - word_base_x,
+					std::min(end_x, word_base_x + BlockChunk::SIZE) - word_base_x);
+			}
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "BlockGrid.h"
+#include "ExplosionStencil.h"
+
+// an explosion waiting to be applied - see World::explode_at()
+struct ExplosionRequest
+{
+	uint32_t x, y;
+	uint16_t r;
+	uint32_t center_damage;
+	double gib_chance;
+};
+
+/**
+ * Explosions requested over a tick, to be applied together at the end of it.
+ *
+ * Requests whose blasts overlap are merged into one region. The damages of its blasts are summed into a buffer of the region
+ * (saturating, which takes the same health off as applying them one after another would), along with a bitmask of the cells
+ * that any of them cover, so each cell of a region is only visited once when it is applied. The cost of resolving the queue
+ * is then bounded by the area blasted rather than the amount of blasts.
+ */
+class ExplosionQueue
+{
+public:
+	static const std::size_t MAX_CACHED_STENCILS = 8;
+
+	/**
+	 * Merged blasts over [x_begin, x_end) x [y_begin, y_end), where x_begin and x_end are multiples of BlockChunk::SIZE.
+	 * Each row is split into words of BlockChunk::SIZE cells, lining up with the rows of the chunks.
+	 */
+	struct Region
+	{
+		uint32_t x_begin, y_begin, x_end, y_end;
+		double gib_chance; // highest of the merged blasts
+
+		std::vector<uint16_t> damages;
+		std::vector<uint64_t> covered_rows;
+
+		inline uint32_t get_words_width() const { return (x_end - x_begin) >> BlockChunk::SIZE_SHIFT; }
+		inline std::size_t get_word_index(uint32_t word_x, uint32_t y) const { return (static_cast<std::size_t>(y - y_begin) * get_words_width()) + word_x; }
+
+		// damages of the cells of word word_x of row y
+		inline const uint16_t* get_word_damages(uint32_t word_x, uint32_t y) const { return damages.data() + (get_word_index(word_x, y) << BlockChunk::SIZE_SHIFT); }
+
+		// bits of the cells of word word_x of row y covered by any of the blasts
+		inline uint64_t get_covered_bits(uint32_t word_x, uint32_t y) const { return covered_rows[get_word_index(word_x, y)]; }
+	};
+
+private:
+	std::vector<ExplosionRequest> requests_;
+
+	// requests sorted by the group of overlapping blasts they're in, and where each group starts in it
+	std::vector<uint32_t> request_groups_;
+	std::vector<uint32_t> grouped_requests_;
+	std::vector<uint32_t> group_starts_;
+
+	Region region_;
+
+	// most recently used last - see get_stencil()
+	std::vector<std::unique_ptr<ExplosionStencil>> stencils_;
+
+	uint32_t find_group(uint32_t request_index);
+
+	// groups requests whose blasts overlap within a world of width x height cells, returning the amount of groups
+	std::size_t group_requests(uint32_t width, uint32_t height);
+
+	// merges the blasts of a group into region_
+	void build_region(std::size_t group, uint32_t width, uint32_t height);
+
+public:
+	ExplosionQueue();
+	~ExplosionQueue();
+
+	// returns the cached stencil of an explosion, computing it if it isn't one of the last MAX_CACHED_STENCILS used
+	const ExplosionStencil& get_stencil(uint16_t r, uint32_t center_damage);
+
+	inline void push(const ExplosionRequest& request) { requests_.push_back(request); }
+	inline void clear() { requests_.clear(); }
+
+	inline bool is_empty() const { return requests_.empty(); }
+	inline const std::vector<ExplosionRequest>& get_requests() const { return requests_; }
+
+	/**
+	 * Merges the requests into regions within a world of width x height cells and calls func(region) for each, clearing the queue.
+	 * Every request should overlap the world.
+	 */
+	template <typename Func>
+	void resolve(uint32_t width, uint32_t height, Func func);
+};
+
+template <typename Func>
+void ExplosionQueue::resolve(uint32_t width, uint32_t height, Func func)
+{
+	const auto group_count = group_requests(width, height);
+	for (std::size_t group = 0; group < group_count; ++group) {
+		build_region(group, width, height);
+		func(static_cast<const Region&>(region_));
+	}
+
+	requests_.clear();
+}
@@ -0,0 +1,43 @@
+#include "ExplosionStencil.h"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+
+ExplosionStencil::ExplosionStencil(uint16_t r, uint32_t center_damage) :
+	r_(r),
+	center_damage_(center_damage)
+{
+	const int64_t r_sq = static_cast<int64_t>(r) * r;
+
+	half_widths_.resize((2 * static_cast<std::size_t>(r)) + 1);
+	row_offsets_.resize(half_widths_.size());
+
+	for (int64_t dy = -r; dy <= r; ++dy) {
+		// widest dx inside of the circle - sqrt() can be off by one either way
+		const int64_t chord_sq = r_sq - (dy * dy);
+		auto half_width = static_cast<int64_t>(std::sqrt(static_cast<double>(chord_sq)));
+		while (half_width * half_width > chord_sq)
+			--half_width;
+		while ((half_width + 1) * (half_width + 1) <= chord_sq)
+			++half_width;
+
+		half_widths_[dy + r] = static_cast<uint16_t>(half_width);
+		row_offsets_[dy + r] = static_cast<uint32_t>(damages_.size());
+
+		for (int64_t dx = -half_width; dx <= half_width; ++dx) {
+			// min damage of explosion is 0.1 * center_damage on a block that is in-range
+			const int64_t inside_r_sq = (dx * dx) + (dy * dy);
+			const uint32_t damage = static_cast<uint32_t>(center_damage * (1.0f - std::max(0.1f, static_cast<float>(inside_r_sq) / r_sq)));
+
+			// healths are 16-bit, so more damage than that makes no difference
+			damages_.push_back(static_cast<uint16_t>(std::min(damage, static_cast<uint32_t>(std::numeric_limits<uint16_t>::max()))));
+		}
+	}
+}
+
+
+ExplosionStencil::~ExplosionStencil()
+{
+}
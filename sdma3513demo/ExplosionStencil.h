@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * Shape and damage falloff of an explosion of some radius and center damage, computed once and reused by every explosion like it.
+ *
+ * Row dy (from -r to r) of the explosion is the chord of cells from dx = -get_half_width(dy) to get_half_width(dy), and the
+ * damages of its cells are stored contiguously so that a whole row of blocks can be damaged at once.
+ */
+class ExplosionStencil
+{
+	uint16_t r_;
+	uint32_t center_damage_;
+
+	std::vector<uint16_t> half_widths_;
+	std::vector<uint32_t> row_offsets_;
+	std::vector<uint16_t> damages_;
+
+public:
+	ExplosionStencil(uint16_t r, uint32_t center_damage);
+	~ExplosionStencil();
+
+	inline uint16_t get_radius() const { return r_; }
+	inline uint32_t get_center_damage() const { return center_damage_; }
+
+	inline uint16_t get_half_width(int32_t dy) const { return half_widths_[dy + r_]; }
+
+	// damages of the cells of row dy, starting at dx = -get_half_width(dy)
+	inline const uint16_t* get_row_damages(int32_t dy) const { return damages_.data() + row_offsets_[dy + r_]; }
+};
@@ -1,13 +1,9 @@
 #include "Game.h"
 
 #include <chrono>
-#include <cassert>
-#include <sstream>
-#include <iomanip>
 
 #include <SFML/Window/Keyboard.hpp>
 #include <SFML/Window/Mouse.hpp>
-#include <SFML/Graphics/Text.hpp>
 
 #include "Helper.h"
 #include "Constants.h"
@@ -15,6 +11,9 @@
 #include "BombEntity.h"
 
 
+const char* const Game::WORLD_CACHE_DIRECTORY = "WorldCache";
+
+
 void Game::spawn_player()
 {
 	if (player_id_ != Entity::INVALID_ENTITY_ID) {
@@ -23,26 +22,39 @@ void Game::spawn_player()
 		player_id_ = Entity::INVALID_ENTITY_ID;
 	}
 
-	auto player = std::make_unique<PlayerTurretEntity>();
+	const auto player = world_.emplace_entity<PlayerTurretEntity>();
 	player->set_position(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, 0.0f));
 
-	const auto player_id = world_.add_entity(static_cast<std::unique_ptr<Entity>>(std::move(player)));
-	if (player_id == Entity::INVALID_ENTITY_ID)
-		throw std::runtime_error("Failed to spawn player entity!");
-
-	player_id_ = player_id;
-	printf("Spawned player with id %d\n", static_cast<int>(player_id));
+	player_id_ = player->get_id();
+	printf("Spawned player with id %d\n", static_cast<int>(player_id_));
 }
 
 
-void Game::create_new_game()
+void Game::create_new_game(bool retry_same_world)
 {
 	printf("Starting new game..\n");
-	active_game_time_ = sf::Time::Zero;
-	world_.generate_new_world(static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count()));
+
+	if (retry_same_world && world_snapshot_) {
+		world_.restore_snapshot(*world_snapshot_);
+		start_new_game();
+	}
+	else {
+		// the world is generated in the background - tick() starts the game once it's ready
+		const auto seed = use_fixed_world_seed_ ? fixed_world_seed_ : static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
+		world_.begin_generate_new_world(seed);
+		game_state_ = GameState::LoadingGame;
+	}
+}
+
+
+void Game::start_new_game()
+{
+	if (world_.get_entity(player_id_) == nullptr)
+		player_id_ = Entity::INVALID_ENTITY_ID; // removed along with the old world
 
 	spawn_player();
 
+	active_game_time_ = sf::Time::Zero;
 	next_bomb_time_ = sf::seconds(2.0f);
 	
 	game_state_ = GameState::ActiveGame;
@@ -50,15 +62,16 @@ void Game::create_new_game()
 }
 
 
-Game::Game(const sf::Font& font, const std::vector<sf::Texture>* explosion_anim_textures) :
-	font_(font),
-	explosion_anim_textures_(explosion_anim_textures),
+Game::Game() :
 	world_(static_cast<uint32_t>(Constants::VIDEO_WIDTH / Block::BLOCK_SIZE.x), static_cast<uint32_t>(Constants::VIDEO_HEIGHT / Block::BLOCK_SIZE.y)),
 	player_id_(Entity::INVALID_ENTITY_ID),
 	game_state_(GameState::PreGame),
-	schedule_new_game_(false)
+	schedule_new_game_(false),
+	schedule_retry_same_world_(false),
+	use_fixed_world_seed_(false),
+	fixed_world_seed_(0)
 {
-	world_.set_explosion_anim_textures(explosion_anim_textures_);
+	world_.set_job_system(&jobs_);
 }
 
 
@@ -67,15 +80,41 @@ Game::~Game()
 }
 
 
+void Game::set_fixed_world_seed(unsigned int seed)
+{
+	printf("Using fixed world seed %u.\n", seed);
+	use_fixed_world_seed_ = true;
+	fixed_world_seed_ = seed;
+
+	// random worlds are never seen twice, so they're not worth caching
+	if (!world_.get_world_cache())
+		world_.set_world_cache(std::make_shared<WorldCache>(WORLD_CACHE_DIRECTORY));
+}
+
+
 void Game::tick(const sf::Vector2f& window_mouse_pos)
 {
 	// load new game if scheduled
 	if (schedule_new_game_) {
 		schedule_new_game_ = false;
-		create_new_game();
+		create_new_game(schedule_retry_same_world_);
 	} 
-	else if ((game_state_ == GameState::PreGame || game_state_ == GameState::GameOver) && sf::Keyboard::isKeyPressed(sf::Keyboard::Space))
+	else if ((game_state_ == GameState::PreGame || game_state_ == GameState::GameOver) && sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) {
+		schedule_new_game_ = true;
+		schedule_retry_same_world_ = false;
+	}
+	else if (game_state_ == GameState::GameOver && world_snapshot_ && sf::Keyboard::isKeyPressed(sf::Keyboard::R)) {
 		schedule_new_game_ = true;
+		schedule_retry_same_world_ = true;
+	}
+
+	// keep generating the new world a bit at a time so that we don't stall
+	if (game_state_ == GameState::LoadingGame) {
+		if (world_.update_generate_new_world(MAX_LOADING_CHUNK_REFRESHES_PER_TICK)) {
+			world_snapshot_ = world_.take_snapshot();
+			start_new_game();
+		}
+	}
 
 	// handle active game logic
 	if (game_state_ == GameState::ActiveGame) {
@@ -84,7 +123,7 @@ void Game::tick(const sf::Vector2f& window_mouse_pos)
 		// point player turret to mouse pos
 		PlayerTurretEntity* player = nullptr;
 		if (player_id_ != Entity::INVALID_ENTITY_ID) {
-			player = static_cast<PlayerTurretEntity*>(world_.get_entity(player_id_));
+			player = entity_cast<PlayerTurretEntity>(world_.get_entity(player_id_));
 		}
 
 		if (player) {
@@ -117,10 +156,9 @@ void Game::tick(const sf::Vector2f& window_mouse_pos)
 					bomb_x_pos = Helper::get_random_float(bomb_x_min, static_cast<float>(Constants::VIDEO_WIDTH));
 				}
 
-				auto bomb = std::make_unique<BombEntity>();
+				const auto bomb = world_.emplace_entity<BombEntity>();
 				bomb->set_position(sf::Vector2f(bomb_x_pos, -20.0f));
 				bomb->assign_player_for_scoring(player_id_);
-				world_.add_entity(static_cast<std::unique_ptr<Entity>>(std::move(bomb)));
 				next_bomb_time_ += sf::seconds(2.5f - (2.455f * std::min(active_game_time_.asSeconds() / (60.0f * 1.75f), 1.0f)));
 				printf("Next bomb will be dropped in %.2f seconds\n", next_bomb_time_.asSeconds());
 			}
@@ -129,10 +167,9 @@ void Game::tick(const sf::Vector2f& window_mouse_pos)
 	else if (game_state_ == GameState::PreGame) {
 		// drop random bombs in pregame because it looks cool
 		if (Helper::get_random_bool(0.10)) {
-			auto bomb = std::make_unique<BombEntity>();
+			const auto bomb = world_.emplace_entity<BombEntity>();
 			bomb->set_position(sf::Vector2f(Helper::get_random_float(0.0f, static_cast<float>(Constants::VIDEO_WIDTH)), -20.0f));
 			bomb->set_respect_gravity(true);
-			world_.add_entity(static_cast<std::unique_ptr<Entity>>(std::move(bomb)));
 		}
 	}
 
@@ -140,104 +177,34 @@ void Game::tick(const sf::Vector2f& window_mouse_pos)
 }
 
 
-void Game::render(sf::RenderTarget& target)
+void Game::fill_render_snapshot(RenderSnapshot& snapshot)
 {
-	target.clear(sf::Color(0, 0, 0));
-	world_.render(target);
-
-	// render ui
-	if (schedule_new_game_) {
-		sf::Text loading_new_game("Loading a new game...", font_, 30);
-		const auto text_bounds = loading_new_game.getLocalBounds();
-		loading_new_game.setOrigin(text_bounds.left + (text_bounds.width * 0.5f), text_bounds.top + (text_bounds.height * 0.5f));
-		loading_new_game.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, Constants::VIDEO_HEIGHT * 0.5f));
-		loading_new_game.setColor(sf::Color(255, 255, 0));
-		target.draw(loading_new_game);
-	}
-	else if (game_state_ == GameState::PreGame) {
-		sf::Text title("City Defender", font_, 40);
-		const auto text_bounds_title = title.getLocalBounds();
-		title.setOrigin(text_bounds_title.left + (text_bounds_title.width * 0.5f), text_bounds_title.top + (text_bounds_title.height * 0.5f));
-		title.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) - 80.0f));
-		title.setColor(sf::Color(255, 255, 0));
-		target.draw(title);
-
-		std::ostringstream oss;
-		oss << "Your job is to defend a city from falling asteroids!" << std::endl;
-		oss << "Be careful, though - if you allow " << MAX_MISSED_BOMBS << " asteroids to hit the city, it's game over!" << std::endl << std::endl;
-		oss << "Move your mouse to aim and left click to shoot missiles.";
-
-		sf::Text p1(oss.str(), font_, 20);
-		const auto text_bounds_p1 = p1.getLocalBounds();
-		p1.setOrigin(text_bounds_p1.left + (text_bounds_p1.width * 0.5f), text_bounds_p1.top + (text_bounds_p1.height * 0.5f));
-		p1.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, Constants::VIDEO_HEIGHT * 0.5f));
-		p1.setColor(sf::Color(255, 155, 0));
-		target.draw(p1);
-
-		sf::Text begin("Press the SPACE key to begin", font_, 20);
-		const auto text_bounds_begin = begin.getLocalBounds();
-		begin.setOrigin(text_bounds_begin.left + (text_bounds_begin.width * 0.5f), text_bounds_begin.top + (text_bounds_begin.height * 0.5f));
-		begin.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) + 80.0f));
-		begin.setColor(sf::Color(255, static_cast<sf::Uint8>(Helper::get_random_int(10, 100)), 0));
-		target.draw(begin);
-	}
-	else if (game_state_ == GameState::ActiveGame || game_state_ == GameState::GameOver) {
-		std::ostringstream oss;
+	world_.fill_render_snapshot(snapshot, sf::FloatRect(0.0f, 0.0f, static_cast<float>(Constants::VIDEO_WIDTH), static_cast<float>(Constants::VIDEO_HEIGHT)));
+
+	// ui
+	auto& hud = snapshot.hud;
+	hud.loading_progress = world_.get_generation_progress();
+	hud.has_player = false;
+	hud.player_score = 0;
+	hud.player_bombs_missed = 0;
+	hud.max_missed_bombs = MAX_MISSED_BOMBS;
+	hud.player_aim_angle = 0.0f;
+	hud.active_game_time = active_game_time_;
+
+	if (schedule_new_game_ || game_state_ == GameState::LoadingGame)
+		hud.screen = HudScreen::Loading;
+	else if (game_state_ == GameState::PreGame)
+		hud.screen = HudScreen::Title;
+	else
+		hud.screen = game_state_ == GameState::GameOver ? HudScreen::GameOver : HudScreen::ActiveGame;
 
-		if (player_id_ != Entity::INVALID_ENTITY_ID) {
-			auto player = static_cast<PlayerTurretEntity*>(world_.get_entity(player_id_));
-			assert(player);
-
-			oss << "Score: " << player->get_player_score();
-
-			sf::Text player_score(oss.str(), font_);
-			player_score.setPosition(sf::Vector2f(0.0f, 0.0f));
-			player_score.setColor(sf::Color(255, 255, 0));
-			target.draw(player_score);
-
-			oss.str("");
-			oss << "Missed: " << std::min(player->get_player_bombs_missed(), MAX_MISSED_BOMBS) << " / " << MAX_MISSED_BOMBS;
-
-			sf::Text player_missed_bombs(oss.str(), font_, 26);
-			player_missed_bombs.setPosition(sf::Vector2f(0.0f, 35.0f));
-			player_missed_bombs.setColor(sf::Color(255, 100, 0));
-			target.draw(player_missed_bombs);
-
-			if (game_state_ == GameState::ActiveGame) {
-				oss.str("");
-				oss << "Aim angle: " << std::fixed << std::setw(4) << std::setprecision(2) << std::setfill('0') << (player->get_aim_angle() + 90.0f) << "deg";
-
-				sf::Text player_aim(oss.str(), font_, 20);
-				const auto text_bounds_aim = player_aim.getLocalBounds();
-				player_aim.setOrigin(text_bounds_aim.left + (text_bounds_aim.width * 0.5f), text_bounds_aim.top + (text_bounds_aim.height * 0.5f));
-				player_aim.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, 20.0f));
-				player_aim.setColor(sf::Color(255, 100, 0));
-				target.draw(player_aim);
-			}
-		}	
-
-		oss.str("");
-		oss << "Defended for: " << std::fixed << std::setw(4) << std::setprecision(2) << std::setfill('0') << active_game_time_.asSeconds() << "s";
-
-		sf::Text game_elapsed_time(oss.str(), font_, 22);
-		game_elapsed_time.setPosition(sf::Vector2f(0.0f, 70.0f));
-		game_elapsed_time.setColor(sf::Color(155, 155, 0));
-		target.draw(game_elapsed_time);
-
-		if (game_state_ == GameState::GameOver) {
-			sf::Text game_over("Game over!", font_, 40);
-			const auto text_bounds = game_over.getLocalBounds();
-			game_over.setOrigin(text_bounds.left + (text_bounds.width * 0.5f), text_bounds.top + (text_bounds.height * 0.5f));
-			game_over.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) - 80.0f));
-			game_over.setColor(sf::Color(255, 50, 0));
-			target.draw(game_over);
-
-			sf::Text again("Press the SPACE key to try again", font_, 20);
-			const auto text_bounds_again = again.getLocalBounds();
-			again.setOrigin(text_bounds_again.left + (text_bounds_again.width * 0.5f), text_bounds_again.top + (text_bounds_again.height * 0.5f));
-			again.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) - 30.0f));
-			again.setColor(sf::Color(255, static_cast<sf::Uint8>(Helper::get_random_int(10, 100)), 0));
-			target.draw(again);
+	if (player_id_ != Entity::INVALID_ENTITY_ID) {
+		const auto player = entity_cast<PlayerTurretEntity>(world_.get_entity(player_id_));
+		if (player) {
+			hud.has_player = true;
+			hud.player_score = player->get_player_score();
+			hud.player_bombs_missed = player->get_player_bombs_missed();
+			hud.player_aim_angle = player->get_aim_angle();
 		}
 	}
 }
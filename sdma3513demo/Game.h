@@ -1,42 +1,57 @@
 #pragma once
 
-#include <SFML/Graphics/RenderTarget.hpp>
-#include <SFML/Graphics/Font.hpp>
 #include <SFML/System/Time.hpp>
 
+#include "JobSystem.h"
 #include "World.h"
+#include "RenderSnapshot.h"
 
 enum class GameState
 {
 	PreGame,
+	LoadingGame,
 	ActiveGame,
 	GameOver
 };
 
 class Game
 {
-	const sf::Font& font_;
-	const std::vector<sf::Texture>* explosion_anim_textures_;
-
+	// shared by everything the game runs in parallel - declared before the world so that it outlives it
+	JobSystem jobs_;
 	World world_;
+	std::shared_ptr<const WorldSnapshot> world_snapshot_; // state of the world right after generating it - for retries
 	EntityId player_id_;
 	sf::Time active_game_time_;
 	sf::Time next_bomb_time_;
 	GameState game_state_;
 	bool schedule_new_game_;
+	bool schedule_retry_same_world_;
+	bool use_fixed_world_seed_;
+	unsigned int fixed_world_seed_;
 
 	void spawn_player();
-	void create_new_game();
+	void create_new_game(bool retry_same_world);
+	void start_new_game();
 
 public:
 	static const uint32_t MAX_MISSED_BOMBS = 10;
+	static const uint32_t MAX_LOADING_CHUNK_REFRESHES_PER_TICK = 64;
+	static const char* const WORLD_CACHE_DIRECTORY;
 
-	Game(const sf::Font& font, const std::vector<sf::Texture>* explosion_anim_textures);
+	Game();
 	~Game();
 
 	inline void new_game() { schedule_new_game_ = true; }
 
+	/**
+	 * Makes every new game take place in the world generated from the given seed, rather than a random one.
+	 * As the same world gets used over and over, it's cached in WORLD_CACHE_DIRECTORY so that it's only ever generated once.
+	 */
+	void set_fixed_world_seed(unsigned int seed);
+
 	void tick(const sf::Vector2f& window_mouse_pos);
-	void render(sf::RenderTarget& target);
+
+	// fills in a snapshot of the game as of the end of the last tick, for the Renderer to draw
+	void fill_render_snapshot(RenderSnapshot& snapshot);
 };
 
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <random>
+#include <limits>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 class Helper
 {
@@ -14,6 +20,9 @@ public:
 	}
 	static inline int get_random_int(int min, int max) { return get_random_int(rng_, min, max); }
 
+	// the RNG used by the overloads that don't take one - only for the simulation thread
+	static inline std::mt19937& get_rng() { return rng_; }
+
 	static inline float get_random_float(std::mt19937& rng, float min, float max)
 	{
 		std::uniform_real_distribution<float> dist(min, max);
@@ -27,4 +36,70 @@ public:
 		return dist(rng);
 	}
 	static inline bool get_random_bool(double true_chance) { return get_random_bool(rng_, true_chance); }
+
+	/**
+	 * Returns how many get_random_bool(true_chance) rolls in a row would come up false before one comes up true, with a single roll.
+	 * Picking each of many things with some chance by skipping ahead this much at a time only costs as much as the amount picked.
+	 */
+	static inline std::size_t get_random_skip_count(std::mt19937& rng, double true_chance)
+	{
+		if (true_chance <= 0.0)
+			return std::numeric_limits<std::size_t>::max();
+		if (true_chance >= 1.0)
+			return 0;
+
+		std::geometric_distribution<std::size_t> dist(true_chance);
+		return dist(rng);
+	}
+	static inline std::size_t get_random_skip_count(double true_chance) { return get_random_skip_count(rng_, true_chance); }
+
+	// fast, stateless integer hash with good avalanche - for noise that must be reproducible without an rng
+	static inline uint32_t hash_u32(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352dU;
+		x ^= x >> 15;
+		x *= 0x846ca68bU;
+		x ^= x >> 16;
+		return x;
+	}
+
+	static inline uint32_t hash_coords(uint32_t x, uint32_t y, uint32_t seed) { return hash_u32(x ^ hash_u32(y ^ hash_u32(seed))); }
+
+	// index of the lowest set bit - x must not be 0
+	static inline uint32_t count_trailing_zeros(uint64_t x)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long i;
+		_BitScanForward64(&i, x);
+		return i;
+#elif defined(_MSC_VER)
+		unsigned long i;
+		if (_BitScanForward(&i, static_cast<unsigned long>(x)))
+			return i;
+
+		_BitScanForward(&i, static_cast<unsigned long>(x >> 32));
+		return i + 32;
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(x));
+#endif
+	}
+
+	static inline uint32_t count_set_bits(uint64_t x)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		return static_cast<uint32_t>(__popcnt64(x));
+#elif defined(_MSC_VER)
+		return __popcnt(static_cast<unsigned int>(x)) + __popcnt(static_cast<unsigned int>(x >> 32));
+#else
+		return static_cast<uint32_t>(__builtin_popcountll(x));
+#endif
+	}
+
+	// mask with bits [begin, end) set, where end <= 64
+	static inline uint64_t get_bit_range_mask(uint32_t begin, uint32_t end)
+	{
+		const auto end_mask = end >= 64 ? ~static_cast<uint64_t>(0) : ((static_cast<uint64_t>(1) << end) - 1);
+		return end_mask & ~((static_cast<uint64_t>(1) << begin) - 1);
+	}
 };
\ No newline at end of file
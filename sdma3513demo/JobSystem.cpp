@@ -0,0 +1,207 @@
+#include "JobSystem.h"
+
+#include <cstdio>
+
+
+namespace
+{
+	// index of the worker running on this thread, or -1 if it isn't one
+	thread_local std::ptrdiff_t current_worker_index = -1;
+	thread_local const JobSystem* current_worker_job_system = nullptr;
+}
+
+
+JobSystem::Job::Job(std::function<void()> func, bool background) :
+	func_(std::move(func)),
+	background_(background),
+	pending_dependencies_(1),
+	finished_(false)
+{
+}
+
+
+JobSystem::Job::~Job()
+{
+}
+
+
+JobSystem::JobSystem(unsigned int thread_count) :
+	queued_job_count_(0),
+	stopping_(false)
+{
+	if (thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+
+	const auto worker_count = std::max(thread_count, 2U) - 1;
+	for (unsigned int i = 0; i < worker_count + 1; ++i)
+		queues_.push_back(std::make_unique<JobQueue>());
+
+	printf("Starting job system with %u workers..\n", worker_count);
+	for (unsigned int i = 0; i < worker_count; ++i)
+		workers_.emplace_back(&JobSystem::worker_main, this, static_cast<std::size_t>(i));
+}
+
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		stopping_ = true;
+	}
+
+	wake_.notify_all();
+	for (auto& worker : workers_)
+		worker.join();
+}
+
+
+std::size_t JobSystem::get_own_queue_index() const
+{
+	return current_worker_job_system == this ? static_cast<std::size_t>(current_worker_index) : workers_.size();
+}
+
+
+JobSystem::JobHandle JobSystem::submit_job(std::function<void()> func, bool background, const std::vector<JobHandle>& dependencies)
+{
+	auto job = std::make_shared<Job>(std::move(func), background);
+
+	for (const auto& dependency : dependencies) {
+		if (!dependency)
+			continue;
+
+		std::lock_guard<std::mutex> lock(dependency->continuations_mutex_);
+		if (!dependency->is_finished()) {
+			++job->pending_dependencies_;
+			dependency->continuations_.push_back(job);
+		}
+	}
+
+	// drop the dependency held while adding the others - whoever drops the last one schedules the job
+	if (--job->pending_dependencies_ == 0)
+		schedule(job);
+
+	return job;
+}
+
+
+void JobSystem::schedule(const JobHandle& job)
+{
+	auto& queue = job->background_ ? background_queue_ : *queues_[get_own_queue_index()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+
+	++queued_job_count_;
+
+	// taking the lock orders this against a worker checking queued_job_count_ before going to sleep
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+	}
+	wake_.notify_one();
+}
+
+
+void JobSystem::run(const JobHandle& job)
+{
+	job->func_();
+	job->func_ = nullptr;
+
+	std::vector<JobHandle> continuations;
+	{
+		std::lock_guard<std::mutex> lock(job->continuations_mutex_);
+		job->finished_.store(true, std::memory_order_release);
+		continuations.swap(job->continuations_);
+	}
+
+	for (const auto& continuation : continuations) {
+		if (--continuation->pending_dependencies_ == 0)
+			schedule(continuation);
+	}
+}
+
+
+bool JobSystem::try_run_job(bool allow_background)
+{
+	if (queued_job_count_.load(std::memory_order_relaxed) == 0)
+		return false;
+
+	JobHandle job;
+	const auto own_index = get_own_queue_index();
+
+	// newest job of our own first, as it's the most likely to still be in cache
+	{
+		auto& queue = *queues_[own_index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+		}
+	}
+
+	// otherwise steal the oldest job of someone else, as it's likely to be the biggest
+	for (std::size_t i = 1; !job && i < queues_.size(); ++i) {
+		auto& queue = *queues_[(own_index + i) % queues_.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+		}
+	}
+
+	if (!job && allow_background) {
+		std::lock_guard<std::mutex> lock(background_queue_.mutex);
+		if (!background_queue_.jobs.empty()) {
+			job = std::move(background_queue_.jobs.front());
+			background_queue_.jobs.pop_front();
+		}
+	}
+
+	if (!job)
+		return false;
+
+	--queued_job_count_;
+	run(job);
+	return true;
+}
+
+
+void JobSystem::worker_main(std::size_t worker_index)
+{
+	current_worker_index = static_cast<std::ptrdiff_t>(worker_index);
+	current_worker_job_system = this;
+
+	while (true) {
+		if (try_run_job(true))
+			continue;
+
+		std::unique_lock<std::mutex> lock(wake_mutex_);
+		if (stopping_)
+			break;
+
+		// schedule() takes the lock before notifying, so a job queued since try_run_job() is either seen here or wakes us up
+		if (queued_job_count_ == 0)
+			wake_.wait(lock);
+	}
+}
+
+
+void JobSystem::wait(const JobHandle& job)
+{
+	if (!job)
+		return;
+
+	// only workers may pick up background jobs while waiting - they'd stall anything else for far too long
+	const bool allow_background = current_worker_job_system == this;
+	while (!job->is_finished()) {
+		if (!try_run_job(allow_background))
+			std::this_thread::yield();
+	}
+}
+
+
+void JobSystem::wait(const std::vector<JobHandle>& jobs)
+{
+	for (const auto& job : jobs)
+		wait(job);
+}
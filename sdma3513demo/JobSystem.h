@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Pool of worker threads shared by everything that wants to run work in parallel.
+ *
+ * Each worker owns a deque of jobs, taking the newest job from the back of its own and stealing the oldest from the front of
+ * the others once it runs dry. Jobs submitted from outside of the workers go into a deque of their own that the workers steal
+ * from. Waiting on a job runs other jobs meanwhile rather than blocking, so jobs can wait on jobs of their own (as
+ * parallel_for() does) without tying up a worker.
+ *
+ * Background jobs are for long-running work like world generation. They only ever run on the workers, so a thread waiting on
+ * something short never gets stuck running one.
+ */
+class JobSystem
+{
+public:
+	class Job
+	{
+		friend class JobSystem;
+
+		std::function<void()> func_;
+		bool background_;
+
+		// dependencies that haven't finished yet, plus one held by submit() while it's adding them
+		std::atomic<uint32_t> pending_dependencies_;
+		std::atomic<bool> finished_;
+
+		// jobs waiting on this one - guarded by continuations_mutex_ along with finished_ being set
+		std::mutex continuations_mutex_;
+		std::vector<std::shared_ptr<Job>> continuations_;
+
+	public:
+		Job(std::function<void()> func, bool background);
+		~Job();
+
+		inline bool is_finished() const { return finished_.load(std::memory_order_acquire); }
+	};
+
+	typedef std::shared_ptr<Job> JobHandle;
+
+private:
+	struct JobQueue
+	{
+		std::mutex mutex;
+		std::deque<JobHandle> jobs;
+	};
+
+	std::vector<std::thread> workers_;
+
+	// one per worker, then one for jobs submitted from any other thread
+	std::vector<std::unique_ptr<JobQueue>> queues_;
+	JobQueue background_queue_;
+
+	// jobs in any of the queues - idle workers sleep until there are some
+	std::atomic<uint32_t> queued_job_count_;
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	bool stopping_;
+
+	// index of the queue that jobs submitted from this thread go into
+	std::size_t get_own_queue_index() const;
+
+	JobHandle submit_job(std::function<void()> func, bool background, const std::vector<JobHandle>& dependencies);
+	void schedule(const JobHandle& job);
+	void run(const JobHandle& job);
+
+	// runs a single job if there is one that this thread may take, returning false otherwise
+	bool try_run_job(bool allow_background);
+
+	void worker_main(std::size_t worker_index);
+
+public:
+	/**
+	 * Starts thread_count - 1 workers, as the threads waiting on jobs also run them - though always at least one, so that
+	 * background jobs have somewhere to run. A thread_count of 0 uses as many threads as the hardware supports.
+	 */
+	explicit JobSystem(unsigned int thread_count = 0);
+	~JobSystem();
+
+	// the amount of threads that can run jobs at once, counting the thread waiting on them
+	inline unsigned int get_thread_count() const { return static_cast<unsigned int>(workers_.size()) + 1; }
+
+	/**
+	 * Queues func to run once every job in dependencies has finished. Null dependencies are ignored.
+	 * Returns a handle that can be waited on, or passed as a dependency of other jobs.
+	 */
+	inline JobHandle submit(std::function<void()> func, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>())
+	{
+		return submit_job(std::move(func), false, dependencies);
+	}
+
+	// same as submit(), but the job is only ever run by a worker
+	inline JobHandle submit_background(std::function<void()> func, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>())
+	{
+		return submit_job(std::move(func), true, dependencies);
+	}
+
+	// runs other jobs until the job has finished
+	void wait(const JobHandle& job);
+	void wait(const std::vector<JobHandle>& jobs);
+
+	/**
+	 * Calls func(begin, end) over contiguous ranges covering [0, count), in parallel, returning once all of them are done.
+	 * Ranges are no smaller than min_range_size (except for the last), and there are only as many as needed to keep every
+	 * thread busy with some left over for stealing.
+	 */
+	template <typename Func>
+	void parallel_for(std::size_t count, std::size_t min_range_size, Func func);
+};
+
+template <typename Func>
+void JobSystem::parallel_for(std::size_t count, std::size_t min_range_size, Func func)
+{
+	if (count == 0)
+		return;
+
+	const std::size_t max_range_count = static_cast<std::size_t>(get_thread_count()) * 4;
+	const std::size_t range_count = std::min(max_range_count, (count + std::max<std::size_t>(min_range_size, 1) - 1) / std::max<std::size_t>(min_range_size, 1));
+
+	if (range_count <= 1) {
+		func(static_cast<std::size_t>(0), count);
+		return;
+	}
+
+	// the first range is run by this thread, while the others are up for grabs
+	std::vector<JobHandle> range_jobs;
+	range_jobs.reserve(range_count - 1);
+	for (std::size_t range = 1; range < range_count; ++range) {
+		const auto begin = (count * range) / range_count;
+		const auto end = (count * (range + 1)) / range_count;
+		range_jobs.push_back(submit([&func, begin, end]() { func(begin, end); }));
+	}
+
+	func(static_cast<std::size_t>(0), count / range_count);
+	wait(range_jobs);
+}
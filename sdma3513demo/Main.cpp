@@ -4,9 +4,12 @@
 #include <SFML/Graphics/RenderTexture.hpp>
 #include <SFML/Graphics/CircleShape.hpp>
 #include <SFML/Window/Event.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Sleep.hpp>
 
 #include "Constants.h"
 #include "Game.h"
+#include "Renderer.h"
 
 
 // Should make it so explosions dont cause "hitches" on some GPUs/drivers...
@@ -54,10 +57,30 @@ int main(int argc, char* argv[])
 	}
 
 	sf::RenderWindow window(sf::VideoMode(Constants::VIDEO_WIDTH, Constants::VIDEO_HEIGHT), "Sean's MA3513 Project Demo - City Defender");
-	window.setFramerateLimit(Constants::FRAME_RATE);
+	window.setFramerateLimit(Constants::MAX_RENDER_FRAME_RATE);
 
 	const auto explosion_anim_textures = prerender_explosion_textures(sf::Vector2f(100.0f, 100.0f));
-	Game game(font, &explosion_anim_textures);
+	Game game;
+
+	// optional first argument is the seed of the world to defend every game
+	if (argc > 1) {
+		char* seed_end;
+		const auto seed = strtoul(argv[1], &seed_end, 10);
+		if (*seed_end != '\0') {
+			fprintf(stderr, "ERROR: Invalid world seed \"%s\" - usage: %s [world seed]\n", argv[1], argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		game.set_fixed_world_seed(static_cast<unsigned int>(seed));
+	}
+
+	// the window is drawn to from the render thread from here on - events still have to be handled on this one
+	Renderer renderer(window, font, &explosion_anim_textures);
+	window.setActive(false);
+	renderer.start();
+
+	sf::Clock tick_clock;
+	auto next_tick_time = sf::Time::Zero;
 
 	while (window.isOpen()) {
 		// handle window message queue
@@ -65,16 +88,29 @@ int main(int argc, char* argv[])
 		while (window.pollEvent(event)) {
 			switch (event.type) {
 			case sf::Event::Closed:
+				renderer.stop();
 				window.close();
-				printf("Window has been closed - stopping.. (might take a while to deallocate everything) \n");
+				printf("Window has been closed - stopping..\n");
 				break;
 			}
 		}
 
+		if (!window.isOpen())
+			break;
+
 		game.tick(window.mapPixelToCoords(sf::Mouse::getPosition(window)));
-		game.render(window);
 
-		window.display();
+		auto snapshot = renderer.acquire_snapshot();
+		game.fill_render_snapshot(*snapshot);
+		renderer.submit_snapshot(std::move(snapshot));
+
+		// tick at a fixed rate, regardless of how fast frames are drawn
+		next_tick_time += Constants::FRAME_TIME;
+		const auto now = tick_clock.getElapsedTime();
+		if (now < next_tick_time)
+			sf::sleep(next_tick_time - now);
+		else if (now - next_tick_time > Constants::MAX_TICK_LAG)
+			next_tick_time = now;
 	}
 
 	return EXIT_SUCCESS;
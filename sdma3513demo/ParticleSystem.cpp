@@ -0,0 +1,342 @@
+#include "ParticleSystem.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <SFML/Graphics/Sprite.hpp>
+
+#include "World.h"
+#include "Helper.h"
+#include "Constants.h"
+
+
+namespace
+{
+	const float PI = 3.14159265f;
+
+	// unit circle points in the same order as sf::CircleShape's
+	struct SmokeCircle
+	{
+		sf::Vector2f points[ParticleRenderer::SMOKE_POINT_COUNT];
+
+		SmokeCircle()
+		{
+			for (uint32_t i = 0; i < ParticleRenderer::SMOKE_POINT_COUNT; ++i) {
+				const float angle = (i * 2.0f * PI / ParticleRenderer::SMOKE_POINT_COUNT) - (PI / 2.0f);
+				points[i] = sf::Vector2f(0.5f + (0.5f * std::cos(angle)), 0.5f + (0.5f * std::sin(angle)));
+			}
+		}
+	};
+
+	const SmokeCircle& get_smoke_circle()
+	{
+		static const SmokeCircle circle;
+		return circle;
+	}
+}
+
+
+ParticleSystem::ParticleSystem()
+{
+}
+
+
+ParticleSystem::~ParticleSystem()
+{
+}
+
+
+void ParticleSystem::emit(ParticleKind kind, const sf::FloatRect& rect, const sf::Vector2f& velocity, const sf::Color& color,
+	float gravity_scale, float growth, float life, float decay, float angle, float spin)
+{
+	pos_x_.push_back(rect.left);
+	pos_y_.push_back(rect.top);
+	vel_x_.push_back(velocity.x);
+	vel_y_.push_back(velocity.y);
+	size_x_.push_back(rect.width);
+	size_y_.push_back(rect.height);
+	gravity_scales_.push_back(gravity_scale);
+	growths_.push_back(growth);
+	lives_.push_back(life);
+	decays_.push_back(decay);
+	angles_.push_back(angle);
+	spins_.push_back(spin);
+	colors_.push_back(color);
+	kinds_.push_back(kind);
+}
+
+
+void ParticleSystem::remove_at(std::size_t index)
+{
+	const auto last = kinds_.size() - 1;
+	pos_x_[index] = pos_x_[last];
+	pos_y_[index] = pos_y_[last];
+	vel_x_[index] = vel_x_[last];
+	vel_y_[index] = vel_y_[last];
+	size_x_[index] = size_x_[last];
+	size_y_[index] = size_y_[last];
+	gravity_scales_[index] = gravity_scales_[last];
+	growths_[index] = growths_[last];
+	lives_[index] = lives_[last];
+	decays_[index] = decays_[last];
+	angles_[index] = angles_[last];
+	spins_[index] = spins_[last];
+	colors_[index] = colors_[last];
+	kinds_[index] = kinds_[last];
+	expired_[index] = expired_[last];
+
+	pos_x_.pop_back();
+	pos_y_.pop_back();
+	vel_x_.pop_back();
+	vel_y_.pop_back();
+	size_x_.pop_back();
+	size_y_.pop_back();
+	gravity_scales_.pop_back();
+	growths_.pop_back();
+	lives_.pop_back();
+	decays_.pop_back();
+	angles_.pop_back();
+	spins_.pop_back();
+	colors_.pop_back();
+	kinds_.pop_back();
+	expired_.pop_back();
+}
+
+
+void ParticleSystem::reserve(std::size_t count)
+{
+	const auto new_size = kinds_.size() + count;
+	if (new_size <= kinds_.capacity())
+		return;
+
+	// keep growing geometrically, as batches come one after another
+	const auto new_capacity = std::max(new_size, 2 * kinds_.capacity());
+	pos_x_.reserve(new_capacity);
+	pos_y_.reserve(new_capacity);
+	vel_x_.reserve(new_capacity);
+	vel_y_.reserve(new_capacity);
+	size_x_.reserve(new_capacity);
+	size_y_.reserve(new_capacity);
+	gravity_scales_.reserve(new_capacity);
+	growths_.reserve(new_capacity);
+	lives_.reserve(new_capacity);
+	decays_.reserve(new_capacity);
+	angles_.reserve(new_capacity);
+	spins_.reserve(new_capacity);
+	colors_.reserve(new_capacity);
+	kinds_.reserve(new_capacity);
+}
+
+
+void ParticleSystem::emit_gib(const sf::Vector2f& pos, const sf::Vector2f& velocity, const sf::Color& color)
+{
+	emit(ParticleKind::Gib, sf::FloatRect(pos, 4.0f * Block::BLOCK_SIZE), velocity, color, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+}
+
+
+void ParticleSystem::emit_fire_gib(const sf::Vector2f& pos, const sf::Vector2f& velocity)
+{
+	// the color is rolled every frame instead
+	emit(ParticleKind::FireGib, sf::FloatRect(pos, 4.0f * Block::BLOCK_SIZE), velocity, sf::Color(255, 0, 0), 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+}
+
+
+void ParticleSystem::emit_fire_gib_burst(const sf::FloatRect& rect, const sf::Vector2f& velocity)
+{
+	const int count = Helper::get_random_int(50, 75);
+	reserve(count);
+
+	for (int i = 0; i < count; ++i) {
+		const sf::Vector2f pos(Helper::get_random_float(rect.left, rect.left + rect.width), Helper::get_random_float(rect.top, rect.top + rect.height));
+		emit_fire_gib(pos, sf::Vector2f(Helper::get_random_float(0.1f, 0.4f) * velocity.x, Helper::get_random_float(0.4f, 1.25f) * velocity.y));
+	}
+}
+
+
+void ParticleSystem::emit_smoke(const sf::FloatRect& rect)
+{
+	emit(ParticleKind::Smoke, rect, sf::Vector2f(), sf::Color(210, 210, 210), 0.0f, 30.8f * Constants::FRAME_TIME.asSeconds(),
+		0.15f, 0.08f * Constants::FRAME_TIME.asSeconds(), Helper::get_random_float(0.0f, 360.0f), 45.0f * Constants::FRAME_TIME.asSeconds());
+}
+
+
+void ParticleSystem::emit_explosion(const sf::FloatRect& rect)
+{
+	emit(ParticleKind::Explosion, rect, sf::Vector2f(), sf::Color::White, 0.0f, 1.0f, 1.0f, 3.0f * Constants::FRAME_TIME.asSeconds(), 0.0f, 0.0f);
+}
+
+
+void ParticleSystem::clear()
+{
+	pos_x_.clear();
+	pos_y_.clear();
+	vel_x_.clear();
+	vel_y_.clear();
+	size_x_.clear();
+	size_y_.clear();
+	gravity_scales_.clear();
+	growths_.clear();
+	lives_.clear();
+	decays_.clear();
+	angles_.clear();
+	spins_.clear();
+	colors_.clear();
+	kinds_.clear();
+	expired_.clear();
+}
+
+
+void ParticleSystem::tick(World& world)
+{
+	const auto count = kinds_.size();
+	const float gravity = world.get_gravity_accel() * Constants::FRAME_TIME.asSeconds();
+
+	// kinds only differ by their coefficients here, so these loops have no branches and vectorize
+	for (std::size_t i = 0; i < count; ++i) {
+		pos_x_[i] += vel_x_[i];
+		pos_y_[i] += vel_y_[i];
+		vel_y_[i] += gravity * gravity_scales_[i];
+	}
+
+	for (std::size_t i = 0; i < count; ++i) {
+		size_x_[i] *= growths_[i];
+		size_y_[i] *= growths_[i];
+		lives_[i] -= decays_[i];
+		angles_[i] += spins_[i];
+	}
+
+	expired_.resize(count);
+	for (std::size_t i = 0; i < count; ++i)
+		expired_[i] = lives_[i] <= 0.0f;
+
+	// gibs above the surface of every column they span can't hit anything, so only the rest are tested against the terrain
+	const auto blocks_width = world.get_blocks_width();
+	for (std::size_t i = 0; i < count; ++i) {
+		if (expired_[i] || (kinds_[i] != ParticleKind::Gib && kinds_[i] != ParticleKind::FireGib))
+			continue;
+
+		if (pos_y_[i] > static_cast<float>(Constants::VIDEO_HEIGHT)) {
+			expired_[i] = 1;
+			continue;
+		}
+
+		const float block_x_begin = std::floor(pos_x_[i] / Block::BLOCK_SIZE.x);
+		const float block_x_end = std::ceil((pos_x_[i] + size_x_[i]) / Block::BLOCK_SIZE.x) + 1.0f;
+		const float block_y_end = std::ceil((pos_y_[i] + size_y_[i]) / Block::BLOCK_SIZE.y) + 1.0f;
+		if (block_x_end <= 0.0f || block_x_begin >= blocks_width)
+			continue;
+
+		const auto surface_y = world.get_highest_column_top(static_cast<uint32_t>(std::max(block_x_begin, 0.0f)),
+			static_cast<uint32_t>(std::min(block_x_end, static_cast<float>(blocks_width))));
+		if (block_y_end <= surface_y)
+			continue;
+
+		if (world.blocks_test_rectangle_collision(sf::FloatRect(pos_x_[i], pos_y_[i], size_x_[i], size_y_[i])).first)
+			expired_[i] = 1;
+	}
+
+	for (std::size_t i = 0; i < kinds_.size();) {
+		if (expired_[i])
+			remove_at(i);
+		else
+			++i;
+	}
+}
+
+
+void ParticleSystem::get_render_states(const World& world, std::vector<ParticleRenderState>& states) const
+{
+	const float gravity = world.get_gravity_accel() * Constants::FRAME_TIME.asSeconds();
+	const auto count = kinds_.size();
+	states.reserve(states.size() + count);
+
+	// undo the last tick's integration to get where each particle started it
+	for (std::size_t i = 0; i < count; ++i) {
+		ParticleRenderState state;
+		state.kind = kinds_[i];
+		state.position = sf::Vector2f(pos_x_[i], pos_y_[i]);
+		state.previous_position = state.position - sf::Vector2f(vel_x_[i], vel_y_[i] - (gravity * gravity_scales_[i]));
+		state.size = sf::Vector2f(size_x_[i], size_y_[i]);
+		state.previous_size = state.size / growths_[i];
+		state.angle = angles_[i];
+		state.previous_angle = angles_[i] - spins_[i];
+		state.life = lives_[i];
+		state.color = colors_[i];
+		states.push_back(state);
+	}
+}
+
+
+ParticleRenderer::ParticleRenderer() :
+	gib_vertices_(sf::Quads),
+	smoke_vertices_(sf::Triangles)
+{
+}
+
+
+ParticleRenderer::~ParticleRenderer()
+{
+}
+
+
+void ParticleRenderer::render(sf::RenderTarget& target, const std::vector<ParticleRenderState>& particles, float alpha,
+	const std::vector<sf::Texture>* explosion_anim_textures, std::mt19937& rng)
+{
+	const auto& smoke_circle = get_smoke_circle();
+	gib_vertices_.clear();
+	smoke_vertices_.clear();
+
+	for (const auto& particle : particles) {
+		const auto pos = particle.previous_position + (alpha * (particle.position - particle.previous_position));
+		const auto size = particle.previous_size + (alpha * (particle.size - particle.previous_size));
+
+		switch (particle.kind) {
+		case ParticleKind::Gib:
+		case ParticleKind::FireGib: {
+			// flickers from the render thread's RNG, as the sim thread's isn't ours to touch
+			const auto color = particle.kind == ParticleKind::FireGib ? Block::get_fire_color(rng) : particle.color;
+			gib_vertices_.append(sf::Vertex(pos, color));
+			gib_vertices_.append(sf::Vertex(pos + sf::Vector2f(size.x, 0.0f), color));
+			gib_vertices_.append(sf::Vertex(pos + size, color));
+			gib_vertices_.append(sf::Vertex(pos + sf::Vector2f(0.0f, size.y), color));
+			break;
+		}
+
+		case ParticleKind::Smoke: {
+			// scaled, then rotated about its top-left like the sf::CircleShape it replaces
+			auto color = particle.color;
+			color.a = static_cast<sf::Uint8>(std::max(particle.life, 0.0f) * 200);
+			const float rotation = (particle.previous_angle + (alpha * (particle.angle - particle.previous_angle))) * PI / 180.0f;
+			const float c = std::cos(rotation), s = std::sin(rotation);
+			const auto transform_point = [&](const sf::Vector2f& p) {
+				const sf::Vector2f scaled(p.x * size.x, p.y * size.y);
+				return pos + sf::Vector2f((scaled.x * c) - (scaled.y * s), (scaled.x * s) + (scaled.y * c));
+			};
+
+			const auto center = transform_point(sf::Vector2f(0.5f, 0.5f));
+			for (uint32_t p = 0; p < SMOKE_POINT_COUNT; ++p) {
+				smoke_vertices_.append(sf::Vertex(center, color));
+				smoke_vertices_.append(sf::Vertex(transform_point(smoke_circle.points[p]), color));
+				smoke_vertices_.append(sf::Vertex(transform_point(smoke_circle.points[(p + 1) % SMOKE_POINT_COUNT]), color));
+			}
+			break;
+		}
+
+		case ParticleKind::Explosion:
+			if (explosion_anim_textures && explosion_anim_textures->size() > 0) {
+				const std::size_t anim_frame = std::min(static_cast<std::size_t>((1.0f - std::min(particle.life, 1.0f)) * explosion_anim_textures->size()),
+					explosion_anim_textures->size() - 1);
+				const auto& frame_texture = (*explosion_anim_textures)[anim_frame];
+
+				sf::Sprite explosion(frame_texture);
+				explosion.setScale(sf::Vector2f(size.x / frame_texture.getSize().x, size.y / frame_texture.getSize().y));
+				explosion.setPosition(pos);
+				target.draw(explosion);
+			}
+			break;
+		}
+	}
+
+	target.draw(smoke_vertices_);
+	target.draw(gib_vertices_);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <random>
+
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
+
+#include "RenderSnapshot.h"
+
+class World;
+
+/**
+ * Fx-only particles of the world, stored as a structure of arrays.
+ *
+ * Every particle is integrated by the same branch-free loops (kinds only differ by their gravity, growth, decay and spin), and
+ * expired particles are swap-removed. They're drawn from render snapshots by a ParticleRenderer.
+ */
+class ParticleSystem
+{
+	std::vector<float> pos_x_, pos_y_;
+	std::vector<float> vel_x_, vel_y_;
+	std::vector<float> size_x_, size_y_;
+	std::vector<float> gravity_scales_;
+	std::vector<float> growths_; // size multiplier per tick
+	std::vector<float> lives_; // density of smoke and explosions - expired once <= 0
+	std::vector<float> decays_; // life lost per tick
+	std::vector<float> angles_, spins_;
+	std::vector<sf::Color> colors_;
+	std::vector<ParticleKind> kinds_;
+
+	std::vector<uint8_t> expired_;
+
+	void emit(ParticleKind kind, const sf::FloatRect& rect, const sf::Vector2f& velocity, const sf::Color& color,
+		float gravity_scale, float growth, float life, float decay, float angle, float spin);
+
+	void remove_at(std::size_t index);
+
+public:
+	ParticleSystem();
+	~ParticleSystem();
+
+	// makes room for count more particles at once, so that emitting a batch of them grows the arrays at most once
+	void reserve(std::size_t count);
+
+	void emit_gib(const sf::Vector2f& pos, const sf::Vector2f& velocity, const sf::Color& color);
+	void emit_fire_gib(const sf::Vector2f& pos, const sf::Vector2f& velocity);
+
+	// throws out a burst of fire gibs from random points of rect, flying at random fractions of velocity
+	void emit_fire_gib_burst(const sf::FloatRect& rect, const sf::Vector2f& velocity);
+	void emit_smoke(const sf::FloatRect& rect);
+	void emit_explosion(const sf::FloatRect& rect);
+
+	void clear();
+
+	void tick(World& world);
+
+	// appends the state of every particle as of the last tick, and as of the tick before it, to states
+	void get_render_states(const World& world, std::vector<ParticleRenderState>& states) const;
+
+	inline std::size_t size() const { return kinds_.size(); }
+};
+
+/**
+ * Draws the particles of render snapshots, on whichever thread renders them.
+ * Gibs and smoke are drawn as a single vertex array each rather than a shape per particle.
+ */
+class ParticleRenderer
+{
+	sf::VertexArray gib_vertices_, smoke_vertices_;
+
+public:
+	// points around the circle of a smoke particle
+	static const uint32_t SMOKE_POINT_COUNT = 30;
+
+	ParticleRenderer();
+	~ParticleRenderer();
+
+	// draws the particles alpha of the way from their state at the start of their tick to the end of it
+	// rng is the render thread's own, for the flicker of fire gibs
+	void render(sf::RenderTarget& target, const std::vector<ParticleRenderState>& particles, float alpha,
+		const std::vector<sf::Texture>* explosion_anim_textures, std::mt19937& rng);
+};
@@ -2,10 +2,11 @@
 
 #include "Constants.h"
 #include "World.h"
+#include "RenderSnapshot.h"
 
 
-PhysicsEntity::PhysicsEntity(bool fx_only) :
-	Entity(fx_only),
+PhysicsEntity::PhysicsEntity(bool fx_only, EntityType type) :
+	Entity(fx_only, type, get_capability_mask(EntityCapability::Physics)),
 	respect_gravity_(true)
 {
 }
@@ -16,7 +17,7 @@ PhysicsEntity::~PhysicsEntity()
 }
 
 
-void PhysicsEntity::tick()
+void PhysicsEntity::tick(WorldCommandBuffer&)
 {
 	const auto world = get_world();
 	if (world) {
@@ -26,4 +27,12 @@ void PhysicsEntity::tick()
 
 		set_position(new_pos);
 	}
-}
\ No newline at end of file
+}
+
+
+void PhysicsEntity::get_render_state(EntityRenderState& state) const
+{
+	Entity::get_render_state(state);
+	state.position = get_position();
+	state.size = sf::Vector2f(rect_.width, rect_.height);
+}
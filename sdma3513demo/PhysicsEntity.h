@@ -9,10 +9,13 @@ class PhysicsEntity : public Entity, public IRectangle, public IPoint
 	bool respect_gravity_;
 	
 public:
-	PhysicsEntity(bool fx_only = false);
+	static inline bool is_instance(const Entity& entity) { return entity.has_capability(EntityCapability::Physics); }
+
+	PhysicsEntity(bool fx_only = false, EntityType type = EntityType::Other);
 	virtual ~PhysicsEntity();
 	
-	virtual void tick() override;
+	virtual void tick(WorldCommandBuffer& commands) override;
+	virtual void get_render_state(EntityRenderState& state) const override;
 
 	inline virtual sf::Vector2f get_velocity() const { return velocity_; }
 	inline virtual void set_velocity(const sf::Vector2f velo) { velocity_ = velo; }
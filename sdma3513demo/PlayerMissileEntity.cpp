@@ -6,15 +6,13 @@
 #include "World.h"
 #include "Helper.h"
 #include "Constants.h"
-#include "PlayerTurretEntity.h"
-#include "SmokeParticleEntity.h"
-#include "ExplosionEffectEntity.h"
+#include "WorldCommandBuffer.h"
 #include "BombEntity.h"
-#include "BlockGibEntity.h"
+#include "RenderSnapshot.h"
 
 
 PlayerMissileEntity::PlayerMissileEntity() :
-	PhysicsEntity(),
+	PhysicsEntity(false, TYPE),
 	player_id_for_scoring_(Entity::INVALID_ENTITY_ID),
 	smoke_time_(sf::seconds(0.4f)) // smoke as soon as it comes out of the turret!
 {
@@ -28,84 +26,80 @@ PlayerMissileEntity::~PlayerMissileEntity()
 }
 
 
-void PlayerMissileEntity::tick()
+void PlayerMissileEntity::tick(WorldCommandBuffer& commands)
 {
 	smoke_time_ += Constants::FRAME_TIME;
 
-	/*
-	// @todo HACK HACK - eliminates a lot of cases of collision failing because we don't do sweeping
-	set_velocity(sf::Vector2f(
-		std::max(std::min(get_velocity().x, get_rectangle().width), -1.0f * get_rectangle().width),
-		std::max(std::min(get_velocity().y, get_rectangle().height), -1.0f * get_rectangle().height)
-	));
-	*/
-
 	auto world = get_world();
 	if (world) {
-		const auto collision_ent_id = world->entity_test_rectangle_collision(get_rectangle());
-		if (collision_ent_id != Entity::INVALID_ENTITY_ID) {
-			// collision with another entity - award score and explode if bomb entity (or derived of)
-			auto collision_ent = dynamic_cast<BombEntity*>(world->get_entity(collision_ent_id));
-			if (collision_ent) {
-				// fire fx
-				const int fire_fx_amount = Helper::get_random_int(50, 75);
-				for (int i = 0; i < fire_fx_amount; ++i) {
-					auto fire_fx_gib = std::make_unique<BlockGibEntity>();
-					fire_fx_gib->set_position(sf::Vector2f(
-						Helper::get_random_float(collision_ent->get_position().x, collision_ent->get_position().x + collision_ent->get_rectangle().width),
-						Helper::get_random_float(collision_ent->get_position().y, collision_ent->get_position().y + collision_ent->get_rectangle().height)
-					));
-					fire_fx_gib->assign_block(std::move(std::make_unique<Block>(BlockType::FireFX)));
-					fire_fx_gib->set_velocity(sf::Vector2f(Helper::get_random_float(0.1f, 0.4f) * get_velocity().x, Helper::get_random_float(0.4f, 1.25f) * get_velocity().y));
-					world->add_entity(static_cast<std::unique_ptr<Entity>>(std::move(fire_fx_gib)));
-				}
-				
-				auto explosion_effect = std::make_unique<ExplosionEffectEntity>();
-				const auto explosion_size = 2.5f * sf::Vector2f(collision_ent->get_rectangle().width, collision_ent->get_rectangle().height);
-				const auto collision_ent_size = sf::Vector2f(collision_ent->get_rectangle().width, collision_ent->get_rectangle().height);
-				explosion_effect->set_rectangle(sf::FloatRect(collision_ent->get_position() + (0.5f * collision_ent_size) - (0.5f * explosion_size), explosion_size));
-				world->add_entity(static_cast<std::unique_ptr<Entity>>(std::move(explosion_effect)));
-
-				// award player score depending on air time? ... idk
-				auto player = static_cast<PlayerTurretEntity*>(world->get_entity(player_id_for_scoring_));
-				if (player)
-					player->add_to_player_score(100);
-
-				collision_ent->mark_for_deletion();
-				mark_for_deletion();
-				return;
-			}
+		// missiles fly through glass and bricks
+		const auto collision_type_mask = Block::BLOCK_TYPE_MASK_ALL & ~(Block::get_block_type_mask(BlockType::Glass) | Block::get_block_type_mask(BlockType::Brick));
+
+		// sweep over the whole of this tick's motion, as we move many blocks per tick and would otherwise skip over things
+		const auto block_hit = world->blocks_sweep_rectangle(get_rectangle(), get_velocity(), collision_type_mask);
+
+		// every bomb we'd reach before the world, nearest first - any of them may be shot down by something else earlier in the
+		// tick, so each gets a fallback group of its own, which is the same as hitting the first one still there once it's our turn
+		static thread_local std::vector<EntitySweepHit> bomb_hits;
+		bomb_hits.clear();
+		world->entity_sweep_rectangle_hits(get_rectangle(), get_velocity(), bomb_hits, Entity::get_type_mask(BombEntity::TYPE), get_id());
+
+		bool recorded_bomb_hit = false;
+		for (const auto& ent_hit : bomb_hits) {
+			if (block_hit.block && ent_hit.t > block_hit.t)
+				break;
+
+			// collision with a bomb - award score and explode it
+			if (recorded_bomb_hit)
+				commands.begin_fallback_group(ent_hit.id);
+			else
+				commands.begin_group(ent_hit.id);
+
+			recorded_bomb_hit = true;
+
+			// fire fx
+			commands.emit_fire_gib_burst(ent_hit.rect, get_velocity());
+
+			const auto collision_ent_size = sf::Vector2f(ent_hit.rect.width, ent_hit.rect.height);
+			const auto explosion_size = 2.5f * collision_ent_size;
+			commands.emit_explosion(sf::FloatRect(sf::Vector2f(ent_hit.rect.left, ent_hit.rect.top) + (0.5f * collision_ent_size) - (0.5f * explosion_size), explosion_size));
+
+			// award player score depending on air time? ... idk
+			commands.add_player_score(player_id_for_scoring_, 100);
+
+			commands.remove_entity(ent_hit.id);
+			commands.remove_entity(get_id());
 		}
-		
-		const auto collision_block = world->blocks_test_rectangle_collision(get_rectangle()).first;
-		if (collision_block && collision_block->get_type() != BlockType::Glass && collision_block->get_type() != BlockType::Brick) {
+
+		// the rest only happens if none of the bombs were still there to hit - our own state is updated regardless, as we're
+		// removed if one was
+		if (recorded_bomb_hit)
+			commands.begin_fallback_group(get_id());
+
+		if (block_hit.block) {
 			// collision with world - do no damage
-			auto explosion_effect = std::make_unique<ExplosionEffectEntity>();
 			const auto explosion_size = 2.5f * sf::Vector2f(get_rectangle().width, get_rectangle().height);
-			explosion_effect->set_rectangle(sf::FloatRect(get_position() - (0.5f * explosion_size), explosion_size));
-			world->add_entity(static_cast<std::unique_ptr<Entity>>(std::move(explosion_effect)));
+			commands.emit_explosion(sf::FloatRect(get_position() + (block_hit.t * get_velocity()) - (0.5f * explosion_size), explosion_size));
 
-			mark_for_deletion();
+			commands.remove_entity(get_id());
 		}
 		else if (get_position().y > static_cast<float>(Constants::VIDEO_HEIGHT))
-			mark_for_deletion();
+			commands.remove_entity(get_id());
 		else if (smoke_time_.asSeconds() > 0.4f) {
-			auto smoke = std::make_unique<SmokeParticleEntity>();
-			smoke->set_rectangle(get_rectangle()); // @todo - spawn smoke behind (depending on velo)
-			world->add_entity(static_cast<std::unique_ptr<Entity>>(std::move(smoke)));
+			commands.emit_smoke(get_rectangle()); // @todo - spawn smoke behind (depending on velo)
 			smoke_time_ -= sf::seconds(0.4f);
 		}
 	}
 
-	PhysicsEntity::tick();
+	PhysicsEntity::tick(commands);
 }
 
 
-void PlayerMissileEntity::render(sf::RenderTarget& target)
+void PlayerMissileEntity::render(sf::RenderTarget& target, const EntityRenderState& state, std::mt19937& rng)
 {
 	sf::CircleShape bomb(0.5f);
-	bomb.setScale(sf::Vector2f(get_rectangle().width, get_rectangle().height));
-	bomb.setFillColor(sf::Color(Helper::get_random_int(100, 255), Helper::get_random_int(0, 185), Helper::get_random_int(0, 185)));
-	bomb.setPosition(get_position());
+	bomb.setScale(state.size);
+	bomb.setFillColor(sf::Color(Helper::get_random_int(rng, 100, 255), Helper::get_random_int(rng, 0, 185), Helper::get_random_int(rng, 0, 185)));
+	bomb.setPosition(state.position);
 	target.draw(bomb);
 }
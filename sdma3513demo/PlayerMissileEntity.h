@@ -10,14 +10,15 @@ class PlayerMissileEntity : public PhysicsEntity
 	EntityId player_id_for_scoring_;
 
 public:
+	static const EntityType TYPE = EntityType::PlayerMissile;
+	static inline bool is_instance(const Entity& entity) { return entity.get_type() == TYPE; }
+
 	PlayerMissileEntity();
 	virtual ~PlayerMissileEntity();
 
 	inline virtual void assign_player_for_scoring(EntityId player_id) { player_id_for_scoring_ = player_id; }
 
-	virtual void tick() override;
-	virtual void render(sf::RenderTarget& target) override;
-
-	inline virtual std::string get_name() const override { return "PlayerMissileEntity"; }
+	virtual void tick(WorldCommandBuffer& commands) override;
+	static void render(sf::RenderTarget& target, const EntityRenderState& state, std::mt19937& rng);
 };
 
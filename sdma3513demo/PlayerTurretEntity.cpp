@@ -7,10 +7,11 @@
 #include "World.h"
 #include "PlayerMissileEntity.h"
 #include "Helper.h"
+#include "RenderSnapshot.h"
 
 
 PlayerTurretEntity::PlayerTurretEntity() :
-	PhysicsEntity(),
+	PhysicsEntity(false, TYPE),
 	aim_angle_(0.0f),
 	player_score_(0),
 	player_missed_bombs_(0),
@@ -34,20 +35,18 @@ void PlayerTurretEntity::fire_missile()
 			const auto aim_angle_rads = (3.141f / 180.0f) * (aim_angle_ - 90.0f);
 			const auto missile_velo = 11.5f * sf::Vector2f(cosf(aim_angle_rads), sinf(aim_angle_rads));
 
-			auto missile = std::make_unique<PlayerMissileEntity>();
+			const auto missile = world->emplace_entity<PlayerMissileEntity>();
 			missile->set_position(get_position() + sf::Vector2f(2.0f - (0.5f * missile->get_rectangle().width), (0.5f * get_rectangle().height) - (0.5f * missile->get_rectangle().height)));
 			missile->set_velocity(missile_velo);
 			missile->assign_player_for_scoring(get_id());
-			world->add_entity(static_cast<std::unique_ptr<Entity>>(std::move(missile)));
 
 			// extra "collat" missiles
 			for (int i = 0; i < 2; ++i) {
-				auto missile_collat = std::make_unique<PlayerMissileEntity>();
+				const auto missile_collat = world->emplace_entity<PlayerMissileEntity>();
 				missile_collat->set_rectangle(sf::FloatRect(sf::Vector2f(), sf::Vector2f(8.0f, 8.0f)));
 				missile_collat->set_position(get_position() + sf::Vector2f(2.0f - (0.5f * missile_collat->get_rectangle().width), (0.5f * get_rectangle().height) - (0.5f * missile_collat->get_rectangle().height)));
 				missile_collat->set_velocity(Helper::get_random_float(1.05f, 1.15f) * missile_velo);
 				missile_collat->assign_player_for_scoring(get_id());
-				world->add_entity(static_cast<std::unique_ptr<Entity>>(std::move(missile_collat)));
 			}
 		}
 
@@ -56,9 +55,9 @@ void PlayerTurretEntity::fire_missile()
 }
 
 
-void PlayerTurretEntity::tick()
+void PlayerTurretEntity::tick(WorldCommandBuffer& commands)
 {
-	PhysicsEntity::tick();
+	PhysicsEntity::tick(commands);
 	if (next_missile_available_time_.asSeconds() > 0.0f)
 		next_missile_available_time_ -= Constants::FRAME_TIME;
 
@@ -66,12 +65,26 @@ void PlayerTurretEntity::tick()
 	if (world) {
 		// snap to highest point of elevation under the player
 		auto turret_bottom_y = get_position().y + get_rectangle().height - 5.0f;
-		while (turret_bottom_y < Constants::VIDEO_HEIGHT) {
-			const auto test_collision_rect = sf::FloatRect(sf::Vector2f(get_position().x + (get_rectangle().width * 0.5f), turret_bottom_y), Block::BLOCK_SIZE);
-			if (world->blocks_test_rectangle_collision(test_collision_rect).first)
-				break; // bottom already seated on a block
+		const auto turret_center_x = get_position().x + (get_rectangle().width * 0.5f);
+		const auto column_x = static_cast<int64_t>(turret_center_x / Block::BLOCK_SIZE.x);
+
+		if (column_x >= 0 && column_x < world->get_blocks_width()) {
+			// usually the top of the column is under the turret, so we can snap straight to it
+			const auto column_top_y = world->get_column_top(static_cast<uint32_t>(column_x)) * Block::BLOCK_SIZE.y;
+			if (column_top_y >= turret_bottom_y)
+				turret_bottom_y = column_top_y;
+		}
+
+		// otherwise probe straight down for the first block under us
+		if (turret_bottom_y < Constants::VIDEO_HEIGHT) {
+			const auto ground_hit = world->blocks_raycast(sf::Vector2f(turret_center_x, turret_bottom_y),
+				sf::Vector2f(0.0f, Constants::VIDEO_HEIGHT - turret_bottom_y));
 
-			turret_bottom_y += Block::BLOCK_SIZE.y; // try again 1 block lower
+			if (!ground_hit.block)
+				turret_bottom_y = static_cast<float>(Constants::VIDEO_HEIGHT); // nothing to stand on
+			else if (ground_hit.t > 0.0f)
+				turret_bottom_y = ground_hit.pos.y * Block::BLOCK_SIZE.y; // seat on top of the block hit
+			// else bottom already seated on a block
 		}
 
 		// valid snap found
@@ -81,18 +94,25 @@ void PlayerTurretEntity::tick()
 }
 
 
-void PlayerTurretEntity::render(sf::RenderTarget& target)
+void PlayerTurretEntity::get_render_state(EntityRenderState& state) const
+{
+	PhysicsEntity::get_render_state(state);
+	state.angle = aim_angle_;
+}
+
+
+void PlayerTurretEntity::render(sf::RenderTarget& target, const EntityRenderState& state, std::mt19937&)
 {
 	sf::RectangleShape turret_cannon(sf::Vector2f(4.0f, 17.5f));
-	turret_cannon.setPosition(get_position());
+	turret_cannon.setPosition(state.position);
 	turret_cannon.setFillColor(sf::Color(55, 55, 55));
 
 	sf::Transform turret_cannon_transform;
-	turret_cannon_transform.rotate(aim_angle_, get_position() + sf::Vector2f(2.0f, 18.5f));
+	turret_cannon_transform.rotate(state.angle, state.position + sf::Vector2f(2.0f, 18.5f));
 	target.draw(turret_cannon, turret_cannon_transform);
 
 	sf::CircleShape turret_base(7.5f);
-	turret_base.setPosition(get_position() + sf::Vector2f(-5.5f, 17.0f));
+	turret_base.setPosition(state.position + sf::Vector2f(-5.5f, 17.0f));
 	turret_base.setFillColor(sf::Color(100, 100, 100));
 	target.draw(turret_base);
 }
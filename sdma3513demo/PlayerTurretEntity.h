@@ -13,13 +13,17 @@ class PlayerTurretEntity : public PhysicsEntity
 	sf::Time next_missile_available_time_;
 
 public:
+	static const EntityType TYPE = EntityType::PlayerTurret;
+	static inline bool is_instance(const Entity& entity) { return entity.get_type() == TYPE; }
+
 	PlayerTurretEntity();
 	virtual ~PlayerTurretEntity();
 
 	virtual void fire_missile();
 
-	virtual void tick() override;
-	virtual void render(sf::RenderTarget& target) override;
+	virtual void tick(WorldCommandBuffer& commands) override;
+	virtual void get_render_state(EntityRenderState& state) const override;
+	static void render(sf::RenderTarget& target, const EntityRenderState& state, std::mt19937& rng);
 
 	inline virtual void set_missile_shoot_delay(const sf::Time& delay) { missile_shoot_delay_ = delay; }
 	inline virtual sf::Time get_missile_shoot_delay() const { return missile_shoot_delay_; }
@@ -35,7 +39,5 @@ public:
 	inline virtual void set_player_bombs_missed(uint32_t missed_bombs) { player_missed_bombs_ = missed_bombs; }
 	inline virtual void increment_player_bombs_missed() { ++player_missed_bombs_; }
 	inline virtual uint32_t get_player_bombs_missed() const { return player_missed_bombs_; }
-
-	inline virtual std::string get_name() const override { return "PlayerTurretEntity"; }
 };
 
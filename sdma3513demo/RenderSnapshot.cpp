@@ -0,0 +1,17 @@
+#include "RenderSnapshot.h"
+
+
+void RenderSnapshot::clear()
+{
+	tick = 0;
+	submit_time = sf::Time::Zero;
+
+	blocks_width = blocks_height = 0;
+	block_layer_patches.clear();
+	block_layer_pixels.clear();
+
+	entities.clear();
+	particles.clear();
+
+	hud = HudRenderState();
+}
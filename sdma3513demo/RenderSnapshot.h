@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <SFML/System/Time.hpp>
+
+#include "Entity.h"
+
+enum class ParticleKind : uint8_t
+{
+	Gib, // falling piece of a block, removed once it hits the terrain
+	FireGib, // gib that flickers like fire
+	Smoke,
+	Explosion
+};
+
+// what an entity looks like at the end of a tick - see Entity::get_render_state()
+struct EntityRenderState
+{
+	EntityId id;
+	EntityType type;
+	sf::Vector2f position, size;
+	float angle;
+};
+
+// what a particle looks like at the end of a tick, along with how it looked at the start of it
+struct ParticleRenderState
+{
+	ParticleKind kind;
+	sf::Vector2f position, previous_position;
+	sf::Vector2f size, previous_size;
+	float angle, previous_angle;
+	float life;
+	sf::Color color;
+};
+
+// rect of the blocks layer modified during a tick, with its pixels
+struct BlockLayerPatch
+{
+	uint32_t x_begin, y_begin, x_end, y_end;
+	std::size_t pixels_offset; // into RenderSnapshot::block_layer_pixels - RGBA rows of the rect, tightly packed
+};
+
+enum class HudScreen : uint8_t
+{
+	Loading,
+	Title,
+	ActiveGame,
+	GameOver
+};
+
+struct HudRenderState
+{
+	HudScreen screen;
+	float loading_progress;
+
+	bool has_player;
+	int32_t player_score;
+	uint32_t player_bombs_missed, max_missed_bombs;
+	float player_aim_angle;
+	sf::Time active_game_time;
+};
+
+/**
+ * Everything needed to draw the game as it was at the end of a tick, so that it can be drawn on another thread while the
+ * next tick runs. Never modified once it's submitted to the Renderer.
+ *
+ * The blocks layer is only sent as the patches modified during the tick, so snapshots must be applied in order - the
+ * rest is whole, and is interpolated against the snapshot before it.
+ */
+struct RenderSnapshot
+{
+	// both set by Renderer::submit_snapshot()
+	uint64_t tick;
+	sf::Time submit_time;
+
+	uint32_t blocks_width, blocks_height;
+	std::vector<BlockLayerPatch> block_layer_patches;
+	std::vector<sf::Uint8> block_layer_pixels;
+
+	std::vector<EntityRenderState> entities; // sorted by ID
+	std::vector<ParticleRenderState> particles;
+
+	HudRenderState hud;
+
+	// empties the snapshot while keeping its memory, so that it can be reused for another tick
+	void clear();
+};
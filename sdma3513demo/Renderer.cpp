@@ -0,0 +1,299 @@
+#include "Renderer.h"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+#include <SFML/Graphics/Text.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+
+#include "Helper.h"
+#include "Constants.h"
+#include "Block.h"
+#include "BombEntity.h"
+#include "PlayerMissileEntity.h"
+#include "PlayerTurretEntity.h"
+
+
+Renderer::Renderer(sf::RenderWindow& window, const sf::Font& font, const std::vector<sf::Texture>* explosion_anim_textures) :
+	window_(window),
+	font_(font),
+	explosion_anim_textures_(explosion_anim_textures),
+	running_(false),
+	next_tick_(0),
+	rng_(std::random_device()())
+{
+}
+
+
+Renderer::~Renderer()
+{
+	stop();
+}
+
+
+std::unique_ptr<RenderSnapshot> Renderer::acquire_snapshot()
+{
+	{
+		std::lock_guard<std::mutex> lock(snapshots_mutex_);
+		if (!free_snapshots_.empty()) {
+			auto snapshot = std::move(free_snapshots_.back());
+			free_snapshots_.pop_back();
+			return snapshot;
+		}
+	}
+
+	auto snapshot = std::make_unique<RenderSnapshot>();
+	snapshot->clear();
+	return snapshot;
+}
+
+
+void Renderer::submit_snapshot(std::unique_ptr<RenderSnapshot> snapshot)
+{
+	snapshot->tick = next_tick_++;
+	snapshot->submit_time = clock_.getElapsedTime();
+
+	std::lock_guard<std::mutex> lock(snapshots_mutex_);
+	pending_snapshots_.push_back(std::move(snapshot));
+}
+
+
+void Renderer::start()
+{
+	if (running_)
+		return;
+
+	printf("Starting render thread..\n");
+	running_ = true;
+	thread_ = std::thread(&Renderer::render_main, this);
+}
+
+
+void Renderer::stop()
+{
+	if (!running_)
+		return;
+
+	printf("Stopping render thread..\n");
+	running_ = false;
+	thread_.join();
+}
+
+
+void Renderer::render_main()
+{
+	window_.setActive(true);
+
+	while (running_) {
+		// take everything submitted since the last frame - the blocks layer needs the patches of all of them, in order
+		{
+			std::lock_guard<std::mutex> lock(snapshots_mutex_);
+			received_snapshots_.swap(pending_snapshots_);
+		}
+
+		while (!received_snapshots_.empty()) {
+			receive_snapshot(std::move(received_snapshots_.front()));
+			received_snapshots_.pop_front();
+		}
+
+		render_frame();
+		window_.display();
+	}
+
+	window_.setActive(false);
+}
+
+
+void Renderer::receive_snapshot(std::unique_ptr<RenderSnapshot> snapshot)
+{
+	if (!blocks_layer_ || blocks_layer_->get_width() != snapshot->blocks_width || blocks_layer_->get_height() != snapshot->blocks_height)
+		blocks_layer_ = std::make_unique<BlockLayer>(snapshot->blocks_width, snapshot->blocks_height);
+
+	for (const auto& patch : snapshot->block_layer_patches)
+		blocks_layer_->write_rect(patch.x_begin, patch.y_begin, patch.x_end, patch.y_end, snapshot->block_layer_pixels.data() + patch.pixels_offset);
+
+	// the snapshot before the previous one is no longer needed
+	auto recycled = std::move(previous_snapshot_);
+	previous_snapshot_ = std::move(current_snapshot_);
+	current_snapshot_ = std::move(snapshot);
+
+	if (recycled) {
+		recycled->clear();
+
+		std::lock_guard<std::mutex> lock(snapshots_mutex_);
+		free_snapshots_.push_back(std::move(recycled));
+	}
+}
+
+
+void Renderer::render_frame()
+{
+	window_.clear(sf::Color(0, 0, 0));
+	if (!current_snapshot_)
+		return;
+
+	// how far we are into the tick after the newest snapshot, which is how far to draw from the previous one towards it
+	const auto time_since_submit = clock_.getElapsedTime() - current_snapshot_->submit_time;
+	const float alpha = std::max(0.0f, std::min(time_since_submit.asSeconds() / Constants::FRAME_TIME.asSeconds(), 1.0f));
+
+	render_blocks();
+	render_entities(alpha);
+	particles_.render(window_, current_snapshot_->particles, alpha, explosion_anim_textures_, rng_);
+	render_hud(current_snapshot_->hud);
+}
+
+
+void Renderer::render_blocks()
+{
+	// draw the level of the layer closest to the output resolution, each texel of level n covering 2^n blocks
+	const auto view_size = window_.getView().getSize();
+	const float pixels_per_block = view_size.x > 0.0f ? (Block::BLOCK_SIZE.x * window_.getSize().x) / view_size.x : 1.0f;
+	const auto level = blocks_layer_->get_level_for_scale(pixels_per_block);
+	const auto level_scale = static_cast<float>(1u << level);
+
+	blocks_layer_->upload(level);
+
+	sf::Sprite blocks_sprite(blocks_layer_->get_texture(level));
+	blocks_sprite.setScale(Block::BLOCK_SIZE * level_scale);
+	window_.draw(blocks_sprite);
+}
+
+
+void Renderer::render_entities(float alpha)
+{
+	for (auto state : current_snapshot_->entities) {
+		// entities that only just spawned have nothing to come from, so they're drawn where they are
+		if (previous_snapshot_) {
+			const auto& previous_entities = previous_snapshot_->entities;
+			const auto previous = std::lower_bound(previous_entities.begin(), previous_entities.end(), state.id,
+				[](const EntityRenderState& s, EntityId id) { return s.id < id; });
+
+			if (previous != previous_entities.end() && previous->id == state.id) {
+				state.position = previous->position + (alpha * (state.position - previous->position));
+				state.size = previous->size + (alpha * (state.size - previous->size));
+
+				// the short way around
+				const auto angle_delta = state.angle - previous->angle;
+				state.angle = previous->angle + (alpha * (angle_delta - (360.0f * floorf((angle_delta + 180.0f) / 360.0f))));
+			}
+		}
+
+		switch (state.type) {
+		case EntityType::Bomb:
+			BombEntity::render(window_, state, rng_);
+			break;
+
+		case EntityType::PlayerMissile:
+			PlayerMissileEntity::render(window_, state, rng_);
+			break;
+
+		case EntityType::PlayerTurret:
+			PlayerTurretEntity::render(window_, state, rng_);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+
+void Renderer::render_hud(const HudRenderState& hud)
+{
+	if (hud.screen == HudScreen::Loading) {
+		std::ostringstream oss;
+		oss << "Loading a new game... " << static_cast<int>(hud.loading_progress * 100.0f) << "%";
+
+		sf::Text loading_new_game(oss.str(), font_, 30);
+		const auto text_bounds = loading_new_game.getLocalBounds();
+		loading_new_game.setOrigin(text_bounds.left + (text_bounds.width * 0.5f), text_bounds.top + (text_bounds.height * 0.5f));
+		loading_new_game.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, Constants::VIDEO_HEIGHT * 0.5f));
+		loading_new_game.setColor(sf::Color(255, 255, 0));
+		window_.draw(loading_new_game);
+	}
+	else if (hud.screen == HudScreen::Title) {
+		sf::Text title("City Defender", font_, 40);
+		const auto text_bounds_title = title.getLocalBounds();
+		title.setOrigin(text_bounds_title.left + (text_bounds_title.width * 0.5f), text_bounds_title.top + (text_bounds_title.height * 0.5f));
+		title.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) - 80.0f));
+		title.setColor(sf::Color(255, 255, 0));
+		window_.draw(title);
+
+		std::ostringstream oss;
+		oss << "Your job is to defend a city from falling asteroids!" << std::endl;
+		oss << "Be careful, though - if you allow " << hud.max_missed_bombs << " asteroids to hit the city, it's game over!" << std::endl << std::endl;
+		oss << "Move your mouse to aim and left click to shoot missiles.";
+
+		sf::Text p1(oss.str(), font_, 20);
+		const auto text_bounds_p1 = p1.getLocalBounds();
+		p1.setOrigin(text_bounds_p1.left + (text_bounds_p1.width * 0.5f), text_bounds_p1.top + (text_bounds_p1.height * 0.5f));
+		p1.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, Constants::VIDEO_HEIGHT * 0.5f));
+		p1.setColor(sf::Color(255, 155, 0));
+		window_.draw(p1);
+
+		sf::Text begin("Press the SPACE key to begin", font_, 20);
+		const auto text_bounds_begin = begin.getLocalBounds();
+		begin.setOrigin(text_bounds_begin.left + (text_bounds_begin.width * 0.5f), text_bounds_begin.top + (text_bounds_begin.height * 0.5f));
+		begin.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) + 80.0f));
+		begin.setColor(sf::Color(255, static_cast<sf::Uint8>(Helper::get_random_int(rng_, 10, 100)), 0));
+		window_.draw(begin);
+	}
+	else if (hud.screen == HudScreen::ActiveGame || hud.screen == HudScreen::GameOver) {
+		std::ostringstream oss;
+
+		if (hud.has_player) {
+			oss << "Score: " << hud.player_score;
+
+			sf::Text player_score(oss.str(), font_);
+			player_score.setPosition(sf::Vector2f(0.0f, 0.0f));
+			player_score.setColor(sf::Color(255, 255, 0));
+			window_.draw(player_score);
+
+			oss.str("");
+			oss << "Missed: " << std::min(hud.player_bombs_missed, hud.max_missed_bombs) << " / " << hud.max_missed_bombs;
+
+			sf::Text player_missed_bombs(oss.str(), font_, 26);
+			player_missed_bombs.setPosition(sf::Vector2f(0.0f, 35.0f));
+			player_missed_bombs.setColor(sf::Color(255, 100, 0));
+			window_.draw(player_missed_bombs);
+
+			if (hud.screen == HudScreen::ActiveGame) {
+				oss.str("");
+				oss << "Aim angle: " << std::fixed << std::setw(4) << std::setprecision(2) << std::setfill('0') << (hud.player_aim_angle + 90.0f) << "deg";
+
+				sf::Text player_aim(oss.str(), font_, 20);
+				const auto text_bounds_aim = player_aim.getLocalBounds();
+				player_aim.setOrigin(text_bounds_aim.left + (text_bounds_aim.width * 0.5f), text_bounds_aim.top + (text_bounds_aim.height * 0.5f));
+				player_aim.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, 20.0f));
+				player_aim.setColor(sf::Color(255, 100, 0));
+				window_.draw(player_aim);
+			}
+		}
+
+		oss.str("");
+		oss << "Defended for: " << std::fixed << std::setw(4) << std::setprecision(2) << std::setfill('0') << hud.active_game_time.asSeconds() << "s";
+
+		sf::Text game_elapsed_time(oss.str(), font_, 22);
+		game_elapsed_time.setPosition(sf::Vector2f(0.0f, 70.0f));
+		game_elapsed_time.setColor(sf::Color(155, 155, 0));
+		window_.draw(game_elapsed_time);
+
+		if (hud.screen == HudScreen::GameOver) {
+			sf::Text game_over("Game over!", font_, 40);
+			const auto text_bounds = game_over.getLocalBounds();
+			game_over.setOrigin(text_bounds.left + (text_bounds.width * 0.5f), text_bounds.top + (text_bounds.height * 0.5f));
+			game_over.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) - 80.0f));
+			game_over.setColor(sf::Color(255, 50, 0));
+			window_.draw(game_over);
+
+			sf::Text again("Press the SPACE key to try again (or R to defend the same city again)", font_, 20);
+			const auto text_bounds_again = again.getLocalBounds();
+			again.setOrigin(text_bounds_again.left + (text_bounds_again.width * 0.5f), text_bounds_again.top + (text_bounds_again.height * 0.5f));
+			again.setPosition(sf::Vector2f(Constants::VIDEO_WIDTH * 0.5f, (Constants::VIDEO_HEIGHT * 0.5f) - 30.0f));
+			again.setColor(sf::Color(255, static_cast<sf::Uint8>(Helper::get_random_int(rng_, 10, 100)), 0));
+			window_.draw(again);
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/Graphics/Font.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/System/Clock.hpp>
+
+#include "RenderSnapshot.h"
+#include "BlockLayer.h"
+#include "ParticleSystem.h"
+
+/**
+ * Draws the game on a thread of its own from the RenderSnapshots submitted at the end of each tick, so that the simulation
+ * keeps ticking at Constants::FRAME_RATE while frames are drawn as fast as the window allows.
+ *
+ * Frames are drawn between the last two snapshots received, interpolated by how far into the tick after the newest one we
+ * are - which puts what's on screen a tick behind the simulation, but keeps motion smooth at any frame rate.
+ *
+ * The renderer keeps its own copy of the blocks layer, built up from the patches of every snapshot in the order they
+ * were submitted, and makes the window's context active on its thread while it's running - so nothing else may draw to
+ * the window until it's stopped.
+ */
+class Renderer
+{
+	sf::RenderWindow& window_;
+	const sf::Font& font_;
+	const std::vector<sf::Texture>* explosion_anim_textures_;
+
+	std::thread thread_;
+	std::atomic<bool> running_;
+	sf::Clock clock_;
+	uint64_t next_tick_;
+
+	// guarded by snapshots_mutex_
+	std::mutex snapshots_mutex_;
+	std::deque<std::unique_ptr<RenderSnapshot>> pending_snapshots_;
+	std::vector<std::unique_ptr<RenderSnapshot>> free_snapshots_;
+
+	// only touched by the render thread
+	std::deque<std::unique_ptr<RenderSnapshot>> received_snapshots_;
+	std::unique_ptr<RenderSnapshot> previous_snapshot_, current_snapshot_;
+	std::unique_ptr<BlockLayer> blocks_layer_;
+	ParticleRenderer particles_;
+	std::mt19937 rng_;
+
+	void render_main();
+
+	// applies the snapshot's blocks layer patches and makes it the one frames are drawn towards
+	void receive_snapshot(std::unique_ptr<RenderSnapshot> snapshot);
+
+	void render_frame();
+	void render_blocks();
+	void render_entities(float alpha);
+	void render_hud(const HudRenderState& hud);
+
+public:
+	Renderer(sf::RenderWindow& window, const sf::Font& font, const std::vector<sf::Texture>* explosion_anim_textures);
+	~Renderer();
+
+	/**
+	 * Returns an empty snapshot to be filled in and passed to submit_snapshot(), reusing one that's no longer needed by
+	 * the render thread if there is one. May be called from any thread.
+	 */
+	std::unique_ptr<RenderSnapshot> acquire_snapshot();
+
+	// hands a snapshot over to the render thread, setting its tick and submit time
+	void submit_snapshot(std::unique_ptr<RenderSnapshot> snapshot);
+
+	// the window's context must not be active on any other thread when the render thread is started
+	void start();
+	void stop();
+
+	inline bool is_running() const { return running_.load(); }
+};
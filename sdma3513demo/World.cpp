@@ -1,284 +1,535 @@
 #include "World.h"
 
 #include <random>
+#include <algorithm>
+#include <thread>
 #include <cassert>
-
-#include <SFML/Graphics/Sprite.hpp>
-#include <SFML/Graphics/RectangleShape.hpp>
+#include <cstring>
 
 #include "Helper.h"
-#include "BlockGibEntity.h"
-#include "ExplosionEffectEntity.h"
+
+
+const sf::Time World::BLOCKS_TEXTURE_UPDATE_BUDGET = sf::milliseconds(2);
+const sf::Time World::BLOCKS_TEXTURE_BACKLOG_REPORT_LATENCY = sf::milliseconds(100);
+const float World::ENTITY_GRID_CELL_SIZE = 32.0f;
 
 
 World::World(uint32_t blocks_width, uint32_t blocks_height) :
-	blocks_width_(blocks_width),
-	blocks_height_(blocks_height),
+	seed_(0),
+	jobs_(nullptr),
+	blocks_(blocks_width, blocks_height),
+	blocks_marked_for_state_update_(blocks_width, blocks_height),
+	blocks_marked_for_texture_update_(blocks_width, blocks_height),
+	blocks_layer_(blocks_width, blocks_height, 1),
 	update_blocks_render_texture_(true),
-	entities_next_id_(0),
-	explosion_anim_textures_(nullptr)
+	generation_seed_(0),
+	generation_columns_filled_(0),
+	generation_finished_(false),
+	is_generating_(false),
+	generation_swapped_(false),
+	generation_refresh_chunks_total_(0),
+	generation_refresh_chunks_done_(0),
+	entity_grid_(blocks_width * Block::BLOCK_SIZE.x, blocks_height * Block::BLOCK_SIZE.y, ENTITY_GRID_CELL_SIZE)
 {
-	blocks_.resize(blocks_width_ * blocks_height_);
-
-	const unsigned int blocks_render_texture_width = static_cast<unsigned int>(blocks_width_ * Block::BLOCK_SIZE.x);
-	const unsigned int blocks_render_texture_height = static_cast<unsigned int>(blocks_height_ * Block::BLOCK_SIZE.y);
-	if (!blocks_render_texture_.create(blocks_render_texture_width, blocks_render_texture_height)) {
-		fprintf(stderr, "Failed to create World blocks render texture! (%dx%d)\n",
-			blocks_render_texture_width, blocks_render_texture_height);
-		throw std::runtime_error("Failed to create blocks render texture");
-	}
-
-	printf("World created (%dx%d blocks)\n", blocks_width_, blocks_height_);
+	printf("World created (%dx%d blocks)\n", get_blocks_width(), get_blocks_height());
 }
 
 
 World::~World()
 {
+	finish_generation_job();
 }
 
 
-void World::refresh_blocks_render_texture()
+bool World::refresh_blocks_layer(uint32_t max_chunks)
 {
-	printf("Performing full refresh on blocks render texture..\n");
-	blocks_marked_for_texture_update_.clear();
-
-	blocks_render_texture_.clear(sf::Color(0, 0, 0, 0));
-
-	for (uint32_t y = 0; y < blocks_height_; ++y) {
-		printf("Texture refresh is %.2f%% complete.. (Hold on!)\n", ((y * 100.0f) / (blocks_height_ - 1)));
-
-		for (uint32_t x = 0; x < blocks_width_; ++x) {
-			const auto block = get_block_at(x, y);
-			if (block) {
-				block->render(
-					blocks_render_texture_,
-					sf::Vector2f(x * Block::BLOCK_SIZE.x, y * Block::BLOCK_SIZE.y)
-				);
+	// gather up to max_chunks dirty chunks to shade at once
+	shade_chunk_positions_.clear();
+	bool finished = true;
+	for (uint32_t chunk_y = 0; chunk_y < blocks_.get_chunks_height() && finished; ++chunk_y) {
+		for (uint32_t chunk_x = 0; chunk_x < blocks_.get_chunks_width(); ++chunk_x) {
+			if (!blocks_.is_chunk_dirty(chunk_x, chunk_y))
+				continue;
+
+			if (shade_chunk_positions_.size() >= max_chunks) {
+				finished = false;
+				break;
 			}
+
+			shade_chunk_positions_.emplace_back(chunk_x, chunk_y);
 		}
 	}
 
-	printf("Blocks texture refresh finished (and hopefully didn't take too long)!\n");
+	shade_chunks(shade_chunk_positions_);
+	const auto refreshed_chunks = static_cast<uint32_t>(shade_chunk_positions_.size());
+	generation_refresh_chunks_done_ += refreshed_chunks;
+
+	if (!finished)
+		return false;
+
+	// every modified chunk has now been redrawn, so any pending per-block texture updates are redundant
+	blocks_marked_for_texture_update_.clear();
+
+	if (refreshed_chunks > 0)
+		printf("Blocks layer refresh finished - refreshed %d chunks (%d allocated)!\n",
+			refreshed_chunks, static_cast<int>(blocks_.get_allocated_chunk_count()));
+
+	return true;
 }
 
 
-void World::remove_entity(decltype(entities_)::iterator it)
+void World::shade_chunks(const std::vector<sf::Vector2<uint32_t>>& chunk_positions)
 {
-	if (it == entities_.end())
-		return;
+	const auto shade_chunk_range = [this, &chunk_positions](std::size_t begin, std::size_t end) {
+		for (auto i = begin; i < end; ++i) {
+			const uint32_t start_x = chunk_positions[i].x << BlockChunk::SIZE_SHIFT;
+			const uint32_t start_y = chunk_positions[i].y << BlockChunk::SIZE_SHIFT;
+			blocks_layer_.shade_rect_pixels(blocks_, seed_, start_x, start_y, start_x + BlockChunk::SIZE, start_y + BlockChunk::SIZE);
+		}
+	};
+
+	// chunks cover disjoint pixels, so only marking them as modified needs doing in turn
+	if (jobs_)
+		jobs_->parallel_for(chunk_positions.size(), 1, shade_chunk_range);
+	else
+		shade_chunk_range(0, chunk_positions.size());
 
-	const auto entity_id = it->first;
-	const auto entity = it->second.get();
+	for (const auto& chunk_pos : chunk_positions) {
+		const uint32_t start_x = chunk_pos.x << BlockChunk::SIZE_SHIFT;
+		const uint32_t start_y = chunk_pos.y << BlockChunk::SIZE_SHIFT;
+		blocks_layer_.mark_shaded(start_x, start_y, start_x + BlockChunk::SIZE, start_y + BlockChunk::SIZE);
+		blocks_.set_chunk_dirty(chunk_pos.x, chunk_pos.y, false);
+	}
+}
 
-	const auto entity_name = entity ? entity->get_name() : "NULL";
-	//printf("Removing entity %d (%s) from world\n", static_cast<int>(entity_id), entity_name.c_str());
+
+void World::remove_entity_at(std::size_t index)
+{
+	const auto entity = entities_.get_at(index);
+	//printf("Removing entity %d (%s) from world\n", static_cast<int>(entity->get_id()), entity->get_name());
 
 	if (!entity->is_fx_only()) {
-		auto non_fx_it = std::find(entities_non_fx_.begin(), entities_non_fx_.end(), entity_id);
-		assert(non_fx_it != entities_non_fx_.end());
-		
-		// swap and pop to remove element
-		printf("Removing non-fx entity %s (id %d)\n", entity_name.c_str(), static_cast<int>(entity_id));
-		std::swap(*non_fx_it, entities_non_fx_.back());
-		entities_non_fx_.pop_back();
+		printf("Removing non-fx entity %s (id %d)\n", entity->get_name(), static_cast<int>(entity->get_id()));
+		entity_grid_.remove(entity);
 	}
 
-	entities_.erase(it);
+	entities_.remove_at(index);
 }
 
 
-void World::update_blocks_render_texture(uint32_t x, uint32_t y)
+void World::remove_entity(EntityId id)
 {
-	if (!update_blocks_render_texture_)
-		return;
-
-	const auto block = get_block_at(x, y);
-	if (block) {
-		block->render(
-			blocks_render_texture_,
-			sf::Vector2f(x * Block::BLOCK_SIZE.x, y * Block::BLOCK_SIZE.y)
-		);
+	const auto entity = entities_.get(id);
+	if (entity && !entity->is_fx_only()) {
+		printf("Removing non-fx entity %s (id %d)\n", entity->get_name(), static_cast<int>(id));
+		entity_grid_.remove(entity);
 	}
-	else {
-		sf::RectangleShape block_eraser(Block::BLOCK_SIZE);
-		block_eraser.setFillColor(sf::Color(0, 0, 0, 0));
-		block_eraser.setPosition(x * Block::BLOCK_SIZE.x, y * Block::BLOCK_SIZE.y);
-		blocks_render_texture_.draw(block_eraser, sf::BlendNone);
+
+	entities_.remove(id);
+}
+
+
+void World::clear_entities()
+{
+	// every pooled entity is gone after this, so each pool can be freed in one go
+	entity_grid_.clear();
+	entities_.clear();
+	for (auto& pool : entity_pools_) {
+		if (pool)
+			pool->reset();
 	}
+
+	particles_.clear();
+
+	// along with the explosions they requested
+	explosions_.clear();
 }
 
 
 void World::clear()
 {
 	printf("Clearing world..\n");
-	for (auto it = entities_.begin(); it != entities_.end();)
-		remove_entity(it++);
+	clear_entities();
+	blocks_.clear();
 
-	entities_next_id_ = 0;
+	blocks_layer_.clear();
+}
 
-	for (auto& b : blocks_)
-		b.reset();
 
-	blocks_render_texture_.clear(sf::Color(0, 0, 0, 0));
+void World::generate_new_world(unsigned int seed)
+{
+	begin_generate_new_world(seed);
+	while (!update_generate_new_world())
+		std::this_thread::yield();
 }
 
 
-void World::generate_new_world(unsigned int seed)
+void World::begin_generate_new_world(unsigned int seed)
 {
-	update_blocks_render_texture_ = false;
+	// a generation that's still in flight is thrown away
+	finish_generation_job();
+
+	printf("Generating new world in the background..\n");
+	is_generating_ = true;
+	generation_swapped_ = false;
+	generation_seed_ = seed;
+	generation_columns_filled_ = 0;
+	generation_finished_ = false;
+	generation_blocks_ = std::make_unique<BlockGrid>(get_blocks_width(), get_blocks_height());
+
+	const auto world_cache = world_cache_;
+	const auto generate = [this, seed, world_cache]() {
+		const WorldGenParams params;
+		const auto params_hash = params.get_hash();
+
+		if (world_cache && world_cache->load(*generation_blocks_, seed, params_hash))
+			generation_columns_filled_ = generation_blocks_->get_width();
+		else {
+			WorldGen gen(*generation_blocks_, seed, params, jobs_, &generation_columns_filled_);
+			gen.generate_world();
+
+			if (world_cache)
+				world_cache->save(*generation_blocks_, seed, params_hash);
+		}
 
-	WorldGen gen(*this, seed);
-	clear();
-	gen.generate_world();
+		generation_finished_ = true;
+	};
 
-	refresh_blocks_render_texture();
-	update_blocks_render_texture_ = true;
+	// without a job system, "in the background" is right here
+	if (jobs_)
+		generation_job_ = jobs_->submit_background(generate);
+	else
+		generate();
 }
 
 
-void World::tick()
+void World::finish_generation_job()
 {
-	// update blocks
-	while (!blocks_marked_for_state_update_.empty()) {
-		const auto block_pos = blocks_marked_for_state_update_.front();
-		const auto block = get_block_at(block_pos.x, block_pos.y);
-		if (block && block->is_destroyed())
-			remove_block_at(block_pos.x, block_pos.y);
-
-		blocks_marked_for_state_update_.pop();
+	if (generation_job_) {
+		jobs_->wait(generation_job_);
+		generation_job_.reset();
 	}
+}
 
-	// update ents
-	for (auto it = entities_.begin(); it != entities_.end();) {
-		auto& e = *it;
-		auto entity = e.second.get();
 
-		if (!entity || entity->is_marked_for_deletion())
-			remove_entity(it++);
-		else {
-			entity->tick();
-			++it;
-		}
+bool World::update_generate_new_world(uint32_t max_refresh_chunks)
+{
+	if (!is_generating_)
+		return true;
+
+	if (!generation_swapped_) {
+		if (!generation_finished_)
+			return false;
+
+		finish_generation_job();
+
+		clear_entities();
+		std::swap(blocks_, *generation_blocks_);
+		generation_blocks_.reset();
+		seed_ = generation_seed_;
+
+		blocks_marked_for_state_update_.clear();
+		blocks_marked_for_texture_update_.clear();
+		blocks_layer_.clear();
+
+		// every chunk of the new world starts off dirty
+		generation_refresh_chunks_total_ = static_cast<uint32_t>(blocks_.get_allocated_chunk_count());
+		generation_refresh_chunks_done_ = 0;
+		generation_swapped_ = true;
+		printf("New world generated (seed: %u) - refreshing its texture..\n", seed_);
 	}
+
+	if (!refresh_blocks_layer(max_refresh_chunks))
+		return false;
+
+	is_generating_ = false;
+	return true;
 }
 
 
-void World::render(sf::RenderTarget& target)
+float World::get_generation_progress() const
 {
-	// render blocks
-	uint32_t updated_blocks = 0;
-	bool force_catchup = false;
+	if (!is_generating_)
+		return 1.0f;
 
-	if (blocks_marked_for_texture_update_.size() > MAX_BLOCKS_TEXTURE_UPDATES_FOR_CATCHUP) {
-		printf("!!! Too many block texture updates scheduled (%d scheduled) - Forcing catch-up for this frame!!!...\n", 
-			static_cast<int>(blocks_marked_for_texture_update_.size()));
+	// filling the blocks takes roughly as long as drawing them
+	if (!generation_swapped_)
+		return 0.5f * (generation_columns_filled_ / static_cast<float>(get_blocks_width()));
 
-		force_catchup = true;
-	}
+	const float refresh_progress = generation_refresh_chunks_done_ / static_cast<float>(std::max(generation_refresh_chunks_total_, 1U));
+	return 0.5f + (0.5f * std::min(refresh_progress, 1.0f));
+}
 
-	while (!blocks_marked_for_texture_update_.empty() && (updated_blocks <= MAX_BLOCKS_TEXTURE_UPDATES_PER_RENDER || force_catchup)) {
-		const std::size_t i = Helper::get_random_int(0, blocks_marked_for_texture_update_.size() - 1);
-		const auto block_pos = blocks_marked_for_texture_update_[i];
-		update_blocks_render_texture(block_pos.x, block_pos.y);
 
-		std::swap(blocks_marked_for_texture_update_[i], blocks_marked_for_texture_update_.back());
-		blocks_marked_for_texture_update_.pop_back();
-		++updated_blocks;
+std::shared_ptr<const WorldSnapshot> World::take_snapshot()
+{
+	auto snapshot = std::make_shared<WorldSnapshot>();
+	snapshot->blocks_ = blocks_.take_snapshot();
+	snapshot->seed_ = seed_;
+
+	printf("Took world snapshot (%d chunks allocated)\n", static_cast<int>(blocks_.get_allocated_chunk_count()));
+	return snapshot;
+}
+
+
+void World::restore_snapshot(const WorldSnapshot& snapshot)
+{
+	printf("Restoring world snapshot..\n");
+	clear_entities();
+
+	std::vector<sf::Vector2<uint32_t>> changed_chunks;
+	blocks_.restore_snapshot(snapshot.blocks_, &changed_chunks);
+
+	// only the changed chunks need reshading, unless the noise of every block changed along with the seed
+	if (seed_ != snapshot.seed_) {
+		seed_ = snapshot.seed_;
+
+		shade_chunk_positions_.clear();
+		for (uint32_t chunk_y = 0; chunk_y < blocks_.get_chunks_height(); ++chunk_y) {
+			for (uint32_t chunk_x = 0; chunk_x < blocks_.get_chunks_width(); ++chunk_x)
+				shade_chunk_positions_.emplace_back(chunk_x, chunk_y);
+		}
+
+		shade_chunks(shade_chunk_positions_);
 	}
+	else
+		shade_chunks(changed_chunks);
+
+	blocks_marked_for_texture_update_.clear();
+	blocks_marked_for_state_update_.clear();
+
+	printf("Restored world snapshot (%d chunks changed)\n", static_cast<int>(changed_chunks.size()));
+}
+
 
-	blocks_render_texture_.display();
-	sf::Sprite blocks_sprite(blocks_render_texture_.getTexture());
-	target.draw(blocks_sprite);
+void World::tick()
+{
+	// update blocks
+	blocks_marked_for_state_update_.consume([this](uint32_t x, uint32_t y) {
+		const auto block = get_block_at(x, y);
+		if (block && block.is_destroyed()) {
+			// no need for another state update once it's gone
+			blocks_.remove_block_at(x, y);
+			if (update_blocks_render_texture_)
+				blocks_marked_for_texture_update_.mark(x, y);
+		}
+	});
 
-	// render ents
-	for (auto& e : entities_) {
-		auto entity = e.second.get();
-		if (entity && !entity->is_marked_for_deletion())
-			entity->render(target);
+	// update ents
+	// removing an entity moves the last one into its place
+	for (std::size_t i = 0; i < entities_.size();) {
+		if (entities_.get_at(i)->is_marked_for_deletion())
+			remove_entity_at(i);
+		else
+			++i;
 	}
+
+	tick_entities();
+
+	// bombs that hit this tick all go off at once
+	resolve_explosions();
+
+	particles_.tick(*this);
 }
 
 
-EntityId World::add_entity(std::unique_ptr<Entity>& entity)
+void World::tick_entities()
 {
-	assert(entities_.find(entities_next_id_) == entities_.end() && "next entity ID already assigned to active entity!");
-	
-	if (entity.get()) {
-		//printf("Adding entity %d (%s) to world\n", static_cast<int>(entities_next_id_), entity.get()->get_name().c_str());
-		entity->assign_world(this, entities_next_id_);
+	// the grid only changes between the entity ticks, so that every query made while ticking sees the start of the tick
+	for (const auto entity : entities_.get_non_fx_entities())
+		entity_grid_.update(entity);
+
+	// entities only add entities from outside of their tick, so the amount ticked is fixed from here on
+	const auto entity_count = entities_.size();
+	const auto range_count = jobs_ ? std::max<std::size_t>(1, std::min<std::size_t>(jobs_->get_thread_count(), entity_count / MIN_ENTITIES_PER_TICK_RANGE)) : 1;
+
+	if (tick_command_buffers_.size() < range_count)
+		tick_command_buffers_.resize(range_count);
+
+	const auto tick_ranges = [this, entity_count, range_count](std::size_t range_begin, std::size_t range_end) {
+		for (auto range_index = range_begin; range_index < range_end; ++range_index) {
+			auto& commands = tick_command_buffers_[range_index];
+			const auto begin = (entity_count * range_index) / range_count;
+			const auto end = (entity_count * (range_index + 1)) / range_count;
+
+			for (auto i = begin; i < end; ++i) {
+				const auto entity = entities_.get_at(i);
+				commands.begin_group(entity->get_id());
+				entity->tick(commands);
+			}
+		}
+	};
+
+	if (range_count > 1)
+		jobs_->parallel_for(range_count, 1, tick_ranges);
+	else
+		tick_ranges(0, 1);
+
+	for (const auto entity : entities_.get_non_fx_entities())
+		entity_grid_.update(entity);
+
+	// ranges are in entity order, so applying them in turn gives the same result as ticking on a single thread
+	for (std::size_t range_index = 0; range_index < range_count; ++range_index)
+		tick_command_buffers_[range_index].apply(*this);
+}
 
-		if (!entity->is_fx_only())
-			entities_non_fx_.emplace_back(entities_next_id_);
 
-		entities_.emplace(entities_next_id_, std::move(entity));
-		return entities_next_id_++;
+void World::fill_render_snapshot(RenderSnapshot& snapshot, const sf::FloatRect& visible_rect)
+{
+	// shade blocks
+	if (update_blocks_render_texture_) {
+		// blocks on screen are redrawn first - the rest catch up over the next ticks if they don't fit in the budget
+		const auto clamp_to_blocks = [](float pos, uint32_t blocks_size) {
+			return static_cast<uint32_t>(std::max(0.0f, std::min(pos, static_cast<float>(blocks_size))));
+		};
+
+		const auto visible_x_begin = clamp_to_blocks(floorf(visible_rect.left / Block::BLOCK_SIZE.x), get_blocks_width());
+		const auto visible_y_begin = clamp_to_blocks(floorf(visible_rect.top / Block::BLOCK_SIZE.y), get_blocks_height());
+		const auto visible_x_end = clamp_to_blocks(ceilf((visible_rect.left + visible_rect.width) / Block::BLOCK_SIZE.x), get_blocks_width());
+		const auto visible_y_end = clamp_to_blocks(ceilf((visible_rect.top + visible_rect.height) / Block::BLOCK_SIZE.y), get_blocks_height());
+
+		const auto updated_blocks = blocks_marked_for_texture_update_.update([this](uint32_t x_begin, uint32_t x_end, uint32_t y) {
+			blocks_layer_.shade_rect(blocks_, seed_, x_begin, y, x_end, y + 1);
+		}, BLOCKS_TEXTURE_UPDATE_BUDGET, visible_x_begin, visible_y_begin, visible_x_end, visible_y_end);
+
+		if (updated_blocks > 0 && blocks_marked_for_texture_update_.is_empty()) {
+			const auto backlog_latency = blocks_marked_for_texture_update_.get_backlog_peak_latency();
+			if (backlog_latency >= BLOCKS_TEXTURE_BACKLOG_REPORT_LATENCY)
+				printf("Blocks texture backlog cleared (redraws lagged by up to %d ms)\n", static_cast<int>(backlog_latency.asMilliseconds()));
+		}
 	}
-	else
-		return Entity::INVALID_ENTITY_ID;
+
+	// hand over everything shaded since the last snapshot - the renderer keeps its own copy of the layer
+	snapshot.blocks_width = get_blocks_width();
+	snapshot.blocks_height = get_blocks_height();
+	blocks_layer_.consume_modified([this, &snapshot](uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end) {
+		const BlockLayerPatch patch = { x_begin, y_begin, x_end, y_end, snapshot.block_layer_pixels.size() };
+		snapshot.block_layer_patches.push_back(patch);
+
+		const auto row_size = static_cast<std::size_t>(x_end - x_begin) * 4;
+		const auto pixels = blocks_layer_.get_pixels();
+		for (uint32_t y = y_begin; y < y_end; ++y) {
+			const auto row = pixels + (((static_cast<std::size_t>(y) * get_blocks_width()) + x_begin) * 4);
+			snapshot.block_layer_pixels.insert(snapshot.block_layer_pixels.end(), row, row + row_size);
+		}
+	});
+
+	// ents
+	snapshot.entities.reserve(entities_.size());
+	for (std::size_t i = 0; i < entities_.size(); ++i) {
+		const auto entity = entities_.get_at(i);
+		if (!entity->is_marked_for_deletion()) {
+			snapshot.entities.emplace_back();
+			entity->get_render_state(snapshot.entities.back());
+		}
+	}
+
+	// sorted so that the renderer can match them up with the entities of the snapshot before
+	std::sort(snapshot.entities.begin(), snapshot.entities.end(), [](const EntityRenderState& a, const EntityRenderState& b) {
+		return a.id < b.id;
+	});
+
+	particles_.get_render_states(*this, snapshot.particles);
 }
 
 
 Entity* World::get_entity(EntityId id)
 {
-	auto it = entities_.find(id);
-	if (it == entities_.end())
-		return nullptr;
-
-	return it->second.get();
+	return entities_.get(id);
 }
 
 
 void World::explode_at(uint32_t x_pos, uint32_t y_pos, uint16_t r, uint32_t center_damage, double gib_chance)
 {
-	if (r == 0 || static_cast<int64_t>(x_pos) - r >= static_cast<int64_t>(blocks_width_) || static_cast<int64_t>(y_pos) - r >= static_cast<int64_t>(blocks_height_))
+	if (r == 0 || static_cast<int64_t>(x_pos) - r >= static_cast<int64_t>(get_blocks_width()) || static_cast<int64_t>(y_pos) - r >= static_cast<int64_t>(get_blocks_height()))
+		return;
+
+	explosions_.push(ExplosionRequest{ x_pos, y_pos, r, center_damage, gib_chance });
+}
+
+
+void World::resolve_explosions()
+{
+	if (explosions_.is_empty())
 		return;
 
-	const uint32_t start_x = static_cast<uint32_t>(std::max(static_cast<int64_t>(x_pos) - r, static_cast<int64_t>(0)));
-	const uint32_t start_y = static_cast<uint32_t>(std::max(static_cast<int64_t>(y_pos) - r, static_cast<int64_t>(0)));
-	const uint32_t end_x = std::min(x_pos + r + 1, blocks_width_);
-	const uint32_t end_y = std::min(y_pos + r + 1, blocks_height_);
-	const uint64_t r_sq = r * r;
-
-	assert(start_x <= end_x && start_y <= end_y);
-
-	for (uint32_t y = start_y; y < end_y; ++y) {
-		for (uint32_t x = start_x; x < end_x; ++x) {
-			// back to a-level with circle equations!
-			const uint64_t inside_r_sq = ((x - x_pos) * (x - x_pos)) + ((y - y_pos) * (y - y_pos));
-
-			if (inside_r_sq <= r_sq) {
-				auto block = get_block_at(x, y);
-				if (block) {
-					// min damage of explosion is 0.1 * center_damage on a block that is in-range
-					const uint32_t block_damage = static_cast<uint32_t>(center_damage * (1.0f - std::max(0.1f, static_cast<float>(inside_r_sq) / r_sq)));
-					block->damage(block_damage);
-					mark_block_for_update(x, y);
-
-					// roll to spawn a gib of this block if we destroyed it
-					if ((block->is_destroyed() || block->get_type() == BlockType::Water) && Helper::get_random_bool(gib_chance)) {
-						auto gib_entity = std::make_unique<BlockGibEntity>();
-						gib_entity->set_position(sf::Vector2f(x * Block::BLOCK_SIZE.x, y * Block::BLOCK_SIZE.y));
-						gib_entity->set_velocity(sf::Vector2f(Helper::get_random_float(-2.0f, 2.0f), Helper::get_random_float(-5.0f, -1.0f)));
-						gib_entity->assign_block(std::make_unique<Block>(*block)); // copy of block
-
-						add_entity(static_cast<std::unique_ptr<Entity>>(std::move(gib_entity)));
-					}
+	BlockTypeMask undamageable_type_mask = 0;
+	for (uint32_t t = 0; t < Block::BLOCK_TYPE_COUNT; ++t) {
+		if (!Block::is_block_type_damageable(static_cast<BlockType>(t)))
+			undamageable_type_mask |= Block::get_block_type_mask(static_cast<BlockType>(t));
+	}
+
+	for (const auto& request : explosions_.get_requests()) {
+		particles_.emit_explosion(sf::FloatRect(
+			sf::Vector2f((request.x - request.r) * Block::BLOCK_SIZE.x, (request.y - request.r) * Block::BLOCK_SIZE.y),
+			sf::Vector2f(2.0f * Block::BLOCK_SIZE.x * request.r, 2.0f * Block::BLOCK_SIZE.y * request.r)
+		));
+	}
+
+	explosions_.resolve(get_blocks_width(), get_blocks_height(), [this, undamageable_type_mask](const ExplosionQueue::Region& region) {
+		explosion_gib_cells_.clear();
+
+		// only visit the cells blasted, a chunk row at a time
+		for (uint32_t y = region.y_begin; y < region.y_end; ++y) {
+			const uint32_t chunk_y = y >> BlockChunk::SIZE_SHIFT;
+			const uint32_t local_y = y & BlockChunk::SIZE_MASK;
+
+			for (uint32_t word_x = 0; word_x < region.get_words_width(); ++word_x) {
+				const auto covered_bits = region.get_covered_bits(word_x, y);
+				if (!covered_bits)
+					continue;
+
+				// skip over empty chunks wholesale
+				const uint32_t chunk_x = (region.x_begin >> BlockChunk::SIZE_SHIFT) + word_x;
+				auto chunk = blocks_.get_chunk(chunk_x, chunk_y);
+				if (!chunk)
+					continue;
+
+				const auto occupied_bits = chunk->occupied_rows[local_y] & covered_bits;
+				if (!occupied_bits)
+					continue;
+
+				// only write to (and so copy, if shared with a snapshot) chunks with something to damage
+				const auto damage_bits = occupied_bits & ~chunk->get_type_row_bits(local_y, undamageable_type_mask);
+				if (damage_bits) {
+					auto writable_chunk = blocks_.get_writable_chunk(chunk_x, chunk_y);
+					writable_chunk->damage_row_span(local_y, 0, BlockChunk::SIZE, region.get_word_damages(word_x, y), damage_bits);
+					chunk = writable_chunk;
+				}
+
+				mark_blocks_for_update(chunk_x, y, occupied_bits);
+
+				// destroyed blocks (and water) may throw out gibs
+				auto gib_bits = occupied_bits & (~chunk->solid_rows[local_y] | chunk->get_type_row_bits(local_y, Block::get_block_type_mask(BlockType::Water)));
+				while (gib_bits) {
+					explosion_gib_cells_.push_back(sf::Vector2<uint32_t>((chunk_x << BlockChunk::SIZE_SHIFT) + Helper::count_trailing_zeros(gib_bits), y));
+					gib_bits &= gib_bits - 1;
 				}
 			}
 		}
-	}
 
-	auto explosion_effect = std::make_unique<ExplosionEffectEntity>();
-	explosion_effect->set_rectangle(sf::FloatRect(
-		sf::Vector2f((x_pos - r) * Block::BLOCK_SIZE.x, (y_pos - r) * Block::BLOCK_SIZE.y),
-		sf::Vector2f(2.0f * Block::BLOCK_SIZE.x * r, 2.0f * Block::BLOCK_SIZE.y * r)
-	));
-	
-	add_entity(static_cast<std::unique_ptr<Entity>>(std::move(explosion_effect)));
+		// pick the cells that throw out gibs by skipping over the ones that don't, so only the gibs thrown out cost a roll, and
+		// gather them at the front so that the particles are emitted in one batch
+		std::size_t gib_count = 0;
+		for (auto skip = Helper::get_random_skip_count(region.gib_chance), i = static_cast<std::size_t>(0); skip < explosion_gib_cells_.size() - i; skip = Helper::get_random_skip_count(region.gib_chance)) {
+			i += skip;
+			explosion_gib_cells_[gib_count++] = explosion_gib_cells_[i++];
+		}
+
+		particles_.reserve(gib_count);
+		for (std::size_t i = 0; i < gib_count; ++i) {
+			const auto x = explosion_gib_cells_[i].x, y = explosion_gib_cells_[i].y;
+			const auto block = blocks_.get_block_at(x, y);
+
+			const sf::Vector2f gib_velocity(Helper::get_random_float(-2.0f, 2.0f), Helper::get_random_float(-5.0f, -1.0f));
+			particles_.emit_gib(sf::Vector2f(x * Block::BLOCK_SIZE.x, y * Block::BLOCK_SIZE.y), gib_velocity,
+				Block::get_block_color(block.get_type(), block.get_health(), get_block_color_noise(x, y)));
+		}
+	});
 }
 
 
-std::pair<Block*, sf::Vector2<uint32_t>> World::blocks_test_rectangle_collision(sf::FloatRect rect)
+std::pair<BlockRef, sf::Vector2<uint32_t>> World::blocks_test_rectangle_collision(sf::FloatRect rect, BlockTypeMask type_mask)
 {
 	// this will probably allow for rectangles with -ve widths or heights to be supported
 	if (rect.width < 0.0f) {
@@ -290,52 +541,279 @@ std::pair<Block*, sf::Vector2<uint32_t>> World::blocks_test_rectangle_collision(
 		rect.height *= -1.0f;
 	}
 
-	int64_t start_x = static_cast<int64_t>(rect.left / Block::BLOCK_SIZE.x);
-	int64_t start_y = static_cast<int64_t>(rect.top / Block::BLOCK_SIZE.y);
-	int64_t end_x = static_cast<int64_t>(ceilf((rect.left + rect.width) / Block::BLOCK_SIZE.x) + 1);
-	int64_t end_y = static_cast<int64_t>(ceilf((rect.top + rect.height) / Block::BLOCK_SIZE.y) + 1);
+	return blocks_test_cells(
+		static_cast<int64_t>(rect.left / Block::BLOCK_SIZE.x),
+		static_cast<int64_t>(rect.top / Block::BLOCK_SIZE.y),
+		static_cast<int64_t>(ceilf((rect.left + rect.width) / Block::BLOCK_SIZE.x) + 1),
+		static_cast<int64_t>(ceilf((rect.top + rect.height) / Block::BLOCK_SIZE.y) + 1),
+		type_mask
+	);
+}
 
+
+std::pair<BlockRef, sf::Vector2<uint32_t>> World::blocks_test_cells(int64_t start_x, int64_t start_y, int64_t end_x, int64_t end_y, BlockTypeMask type_mask)
+{
 	// check if whole rect isn't OOB
-	if ((start_x < 0 && end_x < 0) || (start_x >= blocks_width_ && end_x >= blocks_width_)
-		|| (start_y < 0 && end_y < 0) || (start_y >= blocks_height_ && end_y >= blocks_height_))
-		return std::make_pair(nullptr, sf::Vector2<uint32_t>(-1, -1)); // return null Block and bad pos
+	if (start_x >= end_x || start_y >= end_y || end_x <= 0 || start_x >= get_blocks_width() || end_y <= 0 || start_y >= get_blocks_height())
+		return std::make_pair(BlockRef(), sf::Vector2<uint32_t>(-1, -1)); // return null Block and bad pos
 
 	start_x = std::max(start_x, static_cast<int64_t>(0));
 	start_y = std::max(start_y, static_cast<int64_t>(0));
-	end_x = std::min(end_x, static_cast<int64_t>(blocks_width_));
-	end_y = std::min(end_y, static_cast<int64_t>(blocks_height_));
+	end_x = std::min(end_x, static_cast<int64_t>(get_blocks_width()));
+	end_y = std::min(end_y, static_cast<int64_t>(get_blocks_height()));
+
+	// nothing to hit above the surface of these columns (e.g falling bombs high up in the sky)
+	start_y = std::max(start_y, static_cast<int64_t>(blocks_.get_highest_column_top(static_cast<uint32_t>(start_x), static_cast<uint32_t>(end_x))));
 
 	for (uint32_t y = static_cast<uint32_t>(start_y); y < end_y; ++y) {
-		for (uint32_t x = static_cast<uint32_t>(start_x); x < end_x; ++x) {
-			auto block = get_block_at(x, y);
-			if (block && !block->is_destroyed())
-				return std::make_pair(block, sf::Vector2<uint32_t>(x, y));
+		const uint32_t chunk_y = y >> BlockChunk::SIZE_SHIFT;
+		const uint32_t local_y = y & BlockChunk::SIZE_MASK;
+
+		for (uint32_t chunk_x = static_cast<uint32_t>(start_x) >> BlockChunk::SIZE_SHIFT; (chunk_x << BlockChunk::SIZE_SHIFT) < end_x; ++chunk_x) {
+			// skip over empty chunks wholesale
+			auto chunk = blocks_.get_chunk(chunk_x, chunk_y);
+			if (!chunk)
+				continue;
+
+			const uint32_t chunk_base_x = chunk_x << BlockChunk::SIZE_SHIFT;
+			const uint32_t chunk_start_x = std::max(chunk_base_x, static_cast<uint32_t>(start_x));
+			const uint32_t chunk_end_x = std::min(chunk_base_x + BlockChunk::SIZE, static_cast<uint32_t>(end_x));
+
+			// test the whole span of this chunk row at once using the bitplanes
+			const auto hit_bits = chunk->get_solid_row_bits(local_y, type_mask)
+				& Helper::get_bit_range_mask(chunk_start_x - chunk_base_x, chunk_end_x - chunk_base_x);
+
+			if (hit_bits) {
+				const auto local_x = Helper::count_trailing_zeros(hit_bits);
+				return std::make_pair(blocks_.get_block_ref(chunk_x, chunk_y, BlockChunk::get_cell_index(local_x, local_y)), sf::Vector2<uint32_t>(chunk_base_x + local_x, y));
+			}
+		}
+	}
+
+	return std::make_pair(BlockRef(), sf::Vector2<uint32_t>(-1, -1)); // Just give a bad pos if we dont find anything
+}
+
+
+BlockSweepHit World::blocks_sweep_rectangle(sf::FloatRect rect, sf::Vector2f delta, BlockTypeMask type_mask)
+{
+	if (rect.width < 0.0f) {
+		rect.left += rect.width;
+		rect.width *= -1.0f;
+	}
+	if (rect.height < 0.0f) {
+		rect.top += rect.height;
+		rect.height *= -1.0f;
+	}
+
+	const auto get_cell_x = [](float x) { return static_cast<int64_t>(floorf(x / Block::BLOCK_SIZE.x)); };
+	const auto get_cell_y = [](float y) { return static_cast<int64_t>(floorf(y / Block::BLOCK_SIZE.y)); };
+
+	// anything already overlapped is hit straight away
+	auto hit = blocks_test_cells(get_cell_x(rect.left), get_cell_y(rect.top),
+		get_cell_x(rect.left + rect.width) + 1, get_cell_y(rect.top + rect.height) + 1, type_mask);
+	if (hit.first)
+		return BlockSweepHit{ hit.first, hit.second, 0.0f };
+
+	/*
+	 * Grid traversal (Amanatides & Woo) of the leading corner of the rectangle: next_x is the column that the leading vertical edge
+	 * enters next, at t_next_x, after which it enters one more every t_step_x - likewise for rows. Every time the edge enters a column,
+	 * only the cells of that column which the rectangle spans at that moment are tested, as the rest of its cells were tested before.
+	 */
+	const auto infinity = std::numeric_limits<float>::infinity();
+
+	int64_t next_x = 0, next_y = 0;
+	float t_next_x = infinity, t_next_y = infinity;
+	const float t_step_x = delta.x != 0.0f ? Block::BLOCK_SIZE.x / fabsf(delta.x) : infinity;
+	const float t_step_y = delta.y != 0.0f ? Block::BLOCK_SIZE.y / fabsf(delta.y) : infinity;
+
+	if (delta.x > 0.0f) {
+		next_x = get_cell_x(rect.left + rect.width) + 1;
+		t_next_x = (next_x * Block::BLOCK_SIZE.x - (rect.left + rect.width)) / delta.x;
+	}
+	else if (delta.x < 0.0f) {
+		next_x = get_cell_x(rect.left) - 1;
+		t_next_x = ((next_x + 1) * Block::BLOCK_SIZE.x - rect.left) / delta.x;
+	}
+
+	if (delta.y > 0.0f) {
+		next_y = get_cell_y(rect.top + rect.height) + 1;
+		t_next_y = (next_y * Block::BLOCK_SIZE.y - (rect.top + rect.height)) / delta.y;
+	}
+	else if (delta.y < 0.0f) {
+		next_y = get_cell_y(rect.top) - 1;
+		t_next_y = ((next_y + 1) * Block::BLOCK_SIZE.y - rect.top) / delta.y;
+	}
+
+	const int64_t step_x = delta.x > 0.0f ? 1 : -1;
+	const int64_t step_y = delta.y > 0.0f ? 1 : -1;
+
+	for (;;) {
+		// stop once the edges have left the world in the direction they're moving, as there's nothing more to enter
+		if ((step_x > 0 && next_x >= get_blocks_width()) || (step_x < 0 && next_x < 0))
+			t_next_x = infinity;
+		if ((step_y > 0 && next_y >= get_blocks_height()) || (step_y < 0 && next_y < 0))
+			t_next_y = infinity;
+
+		const auto t = std::min(t_next_x, t_next_y);
+		if (t > 1.0f)
+			break;
+
+		if (t_next_x <= t_next_y) {
+			const auto top = rect.top + (t * delta.y);
+			hit = blocks_test_cells(next_x, get_cell_y(top), next_x + 1, get_cell_y(top + rect.height) + 1, type_mask);
+
+			next_x += step_x;
+			t_next_x += t_step_x;
+		}
+		else {
+			const auto left = rect.left + (t * delta.x);
+			hit = blocks_test_cells(get_cell_x(left), next_y, get_cell_x(left + rect.width) + 1, next_y + 1, type_mask);
+
+			next_y += step_y;
+			t_next_y += t_step_y;
 		}
+
+		if (hit.first)
+			return BlockSweepHit{ hit.first, hit.second, t };
 	}
 
-	return std::make_pair(nullptr, sf::Vector2<uint32_t>(-1, -1)); // Just give a bad pos if we dont find anything
+	return BlockSweepHit{ BlockRef(), sf::Vector2<uint32_t>(-1, -1), 1.0f };
 }
 
 
-EntityId World::entity_test_rectangle_collision(sf::FloatRect rect)
+EntityId World::entity_test_rectangle_collision(sf::FloatRect rect, EntityTypeMask type_mask, EntityId exclude_id)
 {
-	for (std::size_t i = 0; i < entities_non_fx_.size(); ++i) {
-		const auto id = entities_non_fx_[i];
-		const auto entity = dynamic_cast<IRectangle*>(get_entity(id));
-		if (entity) {
-			const auto ent_rect = entity->get_rectangle();
-			if (rect.intersects(ent_rect))
-				return id;
+	auto collision_id = Entity::INVALID_ENTITY_ID;
+	entity_grid_.query(rect, type_mask, exclude_id, [&collision_id](Entity* entity, const sf::FloatRect&) {
+		if (entity->is_marked_for_deletion())
+			return true;
+
+		collision_id = entity->get_id();
+		return false;
+	});
+
+	return collision_id;
+}
+
+
+namespace
+{
+	// slab test - the motion overlaps the other rectangle between the latest entry and the earliest exit of the two axes
+	bool sweep_rectangles(const sf::FloatRect& rect, const sf::Vector2f& delta, const sf::FloatRect& other, float& t_hit)
+	{
+		const auto get_axis_times = [](float begin, float size, float d, float other_begin, float other_size, float& t_enter, float& t_exit) {
+			if (d == 0.0f) {
+				const bool overlapping = begin < other_begin + other_size && other_begin < begin + size;
+				t_enter = overlapping ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+				t_exit = std::numeric_limits<float>::infinity();
+				return;
+			}
+
+			const auto t0 = (other_begin - (begin + size)) / d;
+			const auto t1 = ((other_begin + other_size) - begin) / d;
+			t_enter = std::min(t0, t1);
+			t_exit = std::max(t0, t1);
+		};
+
+		float t_enter_x, t_exit_x, t_enter_y, t_exit_y;
+		get_axis_times(rect.left, rect.width, delta.x, other.left, other.width, t_enter_x, t_exit_x);
+		get_axis_times(rect.top, rect.height, delta.y, other.top, other.height, t_enter_y, t_exit_y);
+
+		const auto t_enter = std::max(std::max(t_enter_x, t_enter_y), 0.0f);
+		const auto t_exit = std::min(t_exit_x, t_exit_y);
+		if (t_enter >= t_exit || t_enter > 1.0f)
+			return false;
+
+		t_hit = t_enter;
+		return true;
+	}
+
+	// bounds of the whole motion of a rectangle with a non-negative size, for the broadphase
+	sf::FloatRect get_sweep_bounds(const sf::FloatRect& rect, const sf::Vector2f& delta)
+	{
+		return sf::FloatRect(
+			rect.left + std::min(delta.x, 0.0f), rect.top + std::min(delta.y, 0.0f),
+			rect.width + fabsf(delta.x), rect.height + fabsf(delta.y)
+		);
+	}
+
+	void normalize_rect(sf::FloatRect& rect)
+	{
+		if (rect.width < 0.0f) {
+			rect.left += rect.width;
+			rect.width *= -1.0f;
+		}
+		if (rect.height < 0.0f) {
+			rect.top += rect.height;
+			rect.height *= -1.0f;
 		}
 	}
-	
-	return Entity::INVALID_ENTITY_ID;
 }
 
 
-Block* World::create_block_at(uint32_t x, uint32_t y, BlockType type)
+EntitySweepHit World::entity_sweep_rectangle(sf::FloatRect rect, sf::Vector2f delta, EntityTypeMask type_mask, EntityId exclude_id)
+{
+	normalize_rect(rect);
+
+	EntitySweepHit collision = { Entity::INVALID_ENTITY_ID, 1.0f, sf::FloatRect() };
+	entity_grid_.query(get_sweep_bounds(rect, delta), type_mask, exclude_id, [&rect, &delta, &collision](Entity* entity, const sf::FloatRect& other) {
+		if (entity->is_marked_for_deletion())
+			return true;
+
+		float t;
+		if (sweep_rectangles(rect, delta, other, t) && t <= collision.t) {
+			// keep the lowest ID on ties so the result doesn't depend on grid order
+			if (t < collision.t || entity->get_id() < collision.id)
+				collision = EntitySweepHit{ entity->get_id(), t, other };
+		}
+
+		return true;
+	});
+
+	return collision;
+}
+
+
+std::size_t World::entity_sweep_rectangle_hits(sf::FloatRect rect, sf::Vector2f delta, std::vector<EntitySweepHit>& out_hits,
+	EntityTypeMask type_mask, EntityId exclude_id)
 {
-	auto block = (blocks_[get_block_index(x, y)] = std::make_unique<Block>(type)).get();
+	normalize_rect(rect);
+
+	const auto old_size = out_hits.size();
+	entity_grid_.query(get_sweep_bounds(rect, delta), type_mask, exclude_id, [&rect, &delta, &out_hits](Entity* entity, const sf::FloatRect& other) {
+		float t;
+		if (!entity->is_marked_for_deletion() && sweep_rectangles(rect, delta, other, t))
+			out_hits.push_back(EntitySweepHit{ entity->get_id(), t, other });
+
+		return true;
+	});
+
+	// ties broken by ID so the order doesn't depend on grid order
+	std::sort(out_hits.begin() + old_size, out_hits.end(), [](const EntitySweepHit& a, const EntitySweepHit& b) {
+		return a.t < b.t || (a.t == b.t && a.id < b.id);
+	});
+
+	return out_hits.size() - old_size;
+}
+
+
+std::size_t World::entity_test_rectangle_collisions(sf::FloatRect rect, std::vector<EntityId>& out_ids, EntityTypeMask type_mask, EntityId exclude_id)
+{
+	const auto old_size = out_ids.size();
+	entity_grid_.query(rect, type_mask, exclude_id, [&out_ids](Entity* entity, const sf::FloatRect&) {
+		if (!entity->is_marked_for_deletion())
+			out_ids.push_back(entity->get_id());
+
+		return true;
+	});
+
+	return out_ids.size() - old_size;
+}
+
+
+BlockRef World::create_block_at(uint32_t x, uint32_t y, BlockType type)
+{
+	const auto block = blocks_.create_block_at(x, y, type);
 	mark_block_for_update(x, y);
 	return block;
 }
@@ -343,11 +821,66 @@ Block* World::create_block_at(uint32_t x, uint32_t y, BlockType type)
 
 void World::remove_block_at(uint32_t x, uint32_t y)
 {
-	blocks_[get_block_index(x, y)].reset();
+	blocks_.remove_block_at(x, y);
 	mark_block_for_update(x, y);
 }
 
 
+void World::fill_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end, BlockType type, bool only_empty)
+{
+	if (x_begin >= x_end || y_begin >= y_end)
+		return;
+
+	// new blocks are never destroyed, so there's no need to mark them for a state update
+	blocks_.fill_rect(x_begin, y_begin, x_end, y_end, type, only_empty);
+	if (update_blocks_render_texture_)
+		blocks_marked_for_texture_update_.mark_rect(x_begin, y_begin, x_end, y_end);
+}
+
+
+WorldGenParams::WorldGenParams() :
+	terrain_y_top_min(0.65f),
+	terrain_y_top_max(0.825f),
+	terrain_y_step_min(-2),
+	terrain_y_step_max(2),
+	terrain_y_step_change_chance(0.25),
+	building_x_min(24),
+	building_x_max(24),
+	building_y_min(20),
+	building_y_max(110),
+	building_foundation_size(20),
+	building_middle_clearance(static_cast<uint32_t>(100 / Block::BLOCK_SIZE.x)),
+	building_gen_chance(0.15)
+{
+}
+
+
+uint32_t WorldGenParams::get_hash() const
+{
+	uint32_t hash = Helper::hash_u32(WorldGen::GENERATOR_VERSION);
+	const auto hash_bytes = [&hash](const void* value, std::size_t size) {
+		uint64_t bits = 0;
+		std::memcpy(&bits, value, size);
+		hash = Helper::hash_u32(hash ^ static_cast<uint32_t>(bits));
+		hash = Helper::hash_u32(hash ^ static_cast<uint32_t>(bits >> 32));
+	};
+
+	hash_bytes(&terrain_y_top_min, sizeof(terrain_y_top_min));
+	hash_bytes(&terrain_y_top_max, sizeof(terrain_y_top_max));
+	hash_bytes(&terrain_y_step_min, sizeof(terrain_y_step_min));
+	hash_bytes(&terrain_y_step_max, sizeof(terrain_y_step_max));
+	hash_bytes(&terrain_y_step_change_chance, sizeof(terrain_y_step_change_chance));
+	hash_bytes(&building_x_min, sizeof(building_x_min));
+	hash_bytes(&building_x_max, sizeof(building_x_max));
+	hash_bytes(&building_y_min, sizeof(building_y_min));
+	hash_bytes(&building_y_max, sizeof(building_y_max));
+	hash_bytes(&building_foundation_size, sizeof(building_foundation_size));
+	hash_bytes(&building_middle_clearance, sizeof(building_middle_clearance));
+	hash_bytes(&building_gen_chance, sizeof(building_gen_chance));
+	return hash;
+}
+
+
 void WorldGen::gen_terrain(uint32_t y_top_min, uint32_t y_top_max, int8_t y_step_min, int8_t y_step_max, double y_step_change_chance)
 {
 	if (y_step_min > y_step_max || y_top_min > y_top_max)
@@ -357,26 +890,15 @@ void WorldGen::gen_terrain(uint32_t y_top_min, uint32_t y_top_max, int8_t y_step
 		y_top_min, y_top_max, y_step_min, y_step_max, y_step_change_chance);
 
 	// start pos of this column of blocks
-	uint32_t y_top = Helper::get_random_int(rng_, y_top_min, y_top_max);
-
-	// rip cache
-	for (uint32_t x = 0; x < world_.get_blocks_width(); ++x) {
-		for (uint32_t y = y_top; y < world_.get_blocks_height(); ++y) {
-			// 1.0 = bottom of column, 0.0 = top of column
-			const float y_from_top = (y - y_top) / static_cast<float>(world_.get_blocks_height() - y_top);
-
-			if (y_from_top <= 0.015f)
-				world_.create_block_at(x, y, BlockType::Grass);
-			else if (y_from_top <= 0.2f)
-				world_.create_block_at(x, y, BlockType::Dirt);
-			else if (y_from_top <= 0.9f)
-				world_.create_block_at(x, y, BlockType::Stone);
-			else
-				world_.create_block_at(x, y, BlockType::Water);
-		}
+	uint32_t y_top = get_column_random_int(0, RANDOM_STREAM_TERRAIN_START, y_top_min, y_top_max);
+
+	// the random walk of the surface is inherently sequential, but it's only one step per column - the filling is done later in bands
+	terrain_tops_.resize(blocks_.get_width());
+	for (uint32_t x = 0; x < blocks_.get_width(); ++x) {
+		terrain_tops_[x] = y_top;
 
-		if (Helper::get_random_bool(rng_, y_step_change_chance)) {
-			y_top += Helper::get_random_int(rng_, y_step_min, y_step_max);
+		if (get_column_random_bool(x, RANDOM_STREAM_TERRAIN_STEP_CHANCE, y_step_change_chance)) {
+			y_top += get_column_random_int(x, RANDOM_STREAM_TERRAIN_STEP, y_step_min, y_step_max);
 			y_top = std::max(std::min(y_top, y_top_max), y_top_min);
 		}
 	}
@@ -392,37 +914,24 @@ void WorldGen::gen_buildings(uint32_t building_x_min, uint32_t building_x_max, u
 	printf("Generating buildings (building_x_min: %d, building_x_max: %d, building_y_min: %d, building_y_max: %d, building_foundation_size: %d, middle_clearance: %d, building_gen_chance: %f) ..\n",
 		building_x_min, building_x_max, building_y_min, building_y_max, building_foundation_size, middle_clearance, building_gen_chance);
 
-	const uint32_t world_clearance_x_min = (world_.get_blocks_width() / 2) - middle_clearance;
-	const uint32_t world_clearance_x_max = (world_.get_blocks_width() / 2) + middle_clearance;
+	const uint32_t world_clearance_x_min = (blocks_.get_width() / 2) - middle_clearance;
+	const uint32_t world_clearance_x_max = (blocks_.get_width() / 2) + middle_clearance;
 
-	// rip cache again
-	for (uint32_t j = 0; j < world_.get_blocks_width(); ++j) {
+	// placement needs to know where the previous building ended, so this is also sequential - cheap as it uses the planned terrain tops
+	for (uint32_t j = 0; j < blocks_.get_width(); ++j) {
 		// roll for building
-		if ((j < world_clearance_x_min || j > world_clearance_x_max) && Helper::get_random_bool(building_gen_chance)) {
-			const uint32_t building_w = Helper::get_random_int(building_x_min, building_x_max);
-			const uint32_t building_h = Helper::get_random_int(building_y_min, building_y_max);
-			uint32_t building_bottom = world_.get_blocks_height(); // take height of world as being invalid y
-
-			// find top of terrain here
-			for (uint32_t y = 0; y < world_.get_blocks_height() - building_foundation_size - 1; ++y) {
-				if (world_.get_block_at(j, y)) {
-					building_bottom = y + building_foundation_size;
-					break;
-				}
-			}
+		if ((j < world_clearance_x_min || j > world_clearance_x_max) && get_column_random_bool(j, RANDOM_STREAM_BUILDING_CHANCE, building_gen_chance)) {
+			const uint32_t building_w = get_column_random_int(j, RANDOM_STREAM_BUILDING_WIDTH, building_x_min, building_x_max);
+			const uint32_t building_h = get_column_random_int(j, RANDOM_STREAM_BUILDING_HEIGHT, building_y_min, building_y_max);
 
 			// we can start building at this level yay
-			if (building_bottom != world_.get_blocks_height()) {
-				for (uint32_t y = building_bottom; y >= 0 && y >= building_bottom - building_h; --y) {
-					for (uint32_t x = j; x < world_.get_blocks_width() && x <= j + building_w; ++x) {
-						if (!world_.get_block_at(x, y)) {
-							if ((x - j) % 10 >= 6 && (y - building_bottom) % 16 >= 12 && x <= j + building_w - 2 && y > building_bottom - building_h + 4)
-								world_.create_block_at(x, y, BlockType::Glass);
-							else
-								world_.create_block_at(x, y, BlockType::Brick);
-						}
-					}
-				}
+			if (terrain_tops_[j] < blocks_.get_height() - building_foundation_size - 1) {
+				BuildingPlacement building;
+				building.x = j;
+				building.width = building_w;
+				building.height = building_h;
+				building.bottom = terrain_tops_[j] + building_foundation_size;
+				buildings_.push_back(building);
 
 				j += building_w + 1;
 			}
@@ -431,10 +940,87 @@ void WorldGen::gen_buildings(uint32_t building_x_min, uint32_t building_x_max, u
 }
 
 
-WorldGen::WorldGen(World & world, unsigned int seed) :
-	world_(world),
+uint32_t WorldGen::get_terrain_layer_end(uint32_t y_top, float depth) const
+{
+	// first y below y_top whose depth (0.0 = top of column, 1.0 = bottom) exceeds the given depth
+	uint32_t y_begin = y_top, y_end = blocks_.get_height();
+	while (y_begin < y_end) {
+		const uint32_t y = y_begin + ((y_end - y_begin) / 2);
+		if ((y - y_top) / static_cast<float>(blocks_.get_height() - y_top) <= depth)
+			y_begin = y + 1;
+		else
+			y_end = y;
+	}
+
+	return y_begin;
+}
+
+
+void WorldGen::fill_band(uint32_t x_begin, uint32_t x_end)
+{
+	// terrain - each column is a run of grass, dirt, stone then water
+	for (uint32_t x = x_begin; x < x_end; ++x) {
+		const uint32_t y_top = terrain_tops_[x];
+
+		const uint32_t grass_end = get_terrain_layer_end(y_top, 0.015f);
+		const uint32_t dirt_end = get_terrain_layer_end(y_top, 0.2f);
+		const uint32_t stone_end = get_terrain_layer_end(y_top, 0.9f);
+
+		blocks_.fill_column(x, y_top, grass_end, BlockType::Grass);
+		blocks_.fill_column(x, grass_end, dirt_end, BlockType::Dirt);
+		blocks_.fill_column(x, dirt_end, stone_end, BlockType::Stone);
+		blocks_.fill_column(x, stone_end, blocks_.get_height(), BlockType::Water);
+
+		if (columns_filled_)
+			++*columns_filled_;
+	}
+
+	// buildings (clipped to this band)
+	for (const auto& building : buildings_) {
+		const uint32_t j = building.x;
+		const uint32_t building_w = building.width;
+		const uint32_t building_h = building.height;
+		const uint32_t building_bottom = building.bottom;
+
+		const uint32_t building_x_begin = std::max(j, x_begin);
+		const uint32_t building_x_end = std::min(std::min(j + building_w + 1, blocks_.get_width()), x_end);
+		if (building_x_begin >= building_x_end)
+			continue;
+
+		const uint32_t building_top = building_bottom > building_h ? building_bottom - building_h : 0;
+
+		// windows are 4x4 on a 10x16 grid, leaving a 5 block tall wall at the top of the building - buildings that reach
+		// the top of the world don't get any
+		const int64_t windows_y_min = static_cast<int64_t>(building_bottom) - building_h + 5;
+		if (windows_y_min >= 1) {
+			const uint32_t windows_x_end = std::min(j + building_w - 1, building_x_end);
+
+			for (int64_t window_y_end = static_cast<int64_t>(building_bottom); window_y_end > windows_y_min; window_y_end -= 16) {
+				const uint32_t window_y_begin = static_cast<uint32_t>(std::max(std::max(window_y_end - 4, windows_y_min), static_cast<int64_t>(building_top)));
+				if (window_y_begin >= window_y_end)
+					continue;
+
+				for (uint32_t window_x = j + 6; window_x < windows_x_end; window_x += 10) {
+					const uint32_t window_x_begin = std::max(window_x, building_x_begin);
+					const uint32_t window_x_end = std::min(window_x + 4, windows_x_end);
+					if (window_x_begin < window_x_end)
+						blocks_.fill_rect(window_x_begin, window_y_begin, window_x_end, static_cast<uint32_t>(window_y_end), BlockType::Glass, true);
+				}
+			}
+		}
+
+		blocks_.fill_rect(building_x_begin, building_top, building_x_end, building_bottom + 1, BlockType::Brick, true);
+	}
+}
+
+
+WorldGen::WorldGen(BlockGrid& blocks, unsigned int seed, const WorldGenParams& params, JobSystem* jobs,
+	std::atomic<uint32_t>* columns_filled) :
+	blocks_(blocks),
 	seed_(seed),
-	rng_(seed)
+	params_(params),
+	jobs_(jobs),
+	columns_filled_(columns_filled)
 {
 }
 
@@ -449,11 +1035,28 @@ void WorldGen::generate_world()
 	printf("Generating world (seed: %u) ..\n", seed_);
 
 	gen_terrain(
-		static_cast<uint32_t>(0.65f * world_.get_blocks_height()),
-		static_cast<uint32_t>(0.825f * world_.get_blocks_height()),
-		-2, 2,
-		0.25
+		static_cast<uint32_t>(params_.terrain_y_top_min * blocks_.get_height()),
+		static_cast<uint32_t>(params_.terrain_y_top_max * blocks_.get_height()),
+		params_.terrain_y_step_min, params_.terrain_y_step_max,
+		params_.terrain_y_step_change_chance
 	);
 
-	gen_buildings(24, 24, 20, 110, 20, static_cast<uint32_t>(100 / Block::BLOCK_SIZE.x), 0.15);
-}
+	gen_buildings(params_.building_x_min, params_.building_x_max, params_.building_y_min, params_.building_y_max,
+		params_.building_foundation_size, params_.building_middle_clearance, params_.building_gen_chance);
+
+	// fill in bands of whole chunk columns so that no two jobs ever write to the same chunk
+	const uint32_t chunk_columns = blocks_.get_chunks_width();
+	const auto fill_chunk_columns = [this](std::size_t chunk_x_begin, std::size_t chunk_x_end) {
+		fill_band(static_cast<uint32_t>(chunk_x_begin) << BlockChunk::SIZE_SHIFT,
+			std::min(static_cast<uint32_t>(chunk_x_end) << BlockChunk::SIZE_SHIFT, blocks_.get_width()));
+	};
+
+	if (jobs_) {
+		printf("Filling world in parallel (%u threads)..\n", jobs_->get_thread_count());
+		jobs_->parallel_for(chunk_columns, 1, fill_chunk_columns);
+	}
+	else {
+		printf("Filling world..\n");
+		fill_chunk_columns(0, chunk_columns);
+	}
+}
\ No newline at end of file
@@ -1,117 +1,453 @@
 #pragma once
 
 #include <vector>
-#include <queue>
-#include <unordered_map>
 #include <memory>
 #include <random>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <algorithm>
 
 #include <SFML/Graphics/RenderTarget.hpp>
-#include <SFML/Graphics/RenderTexture.hpp>
 
 #include "Block.h"
+#include "BlockGrid.h"
+#include "BlockDirtyMap.h"
+#include "BlockLayer.h"
+#include "BlockUpdateScheduler.h"
+#include "WorldCache.h"
 #include "Entity.h"
+#include "EntitySlotMap.h"
+#include "EntityGrid.h"
+#include "ParticleSystem.h"
+#include "ExplosionQueue.h"
+#include "WorldCommandBuffer.h"
+#include "JobSystem.h"
+#include "RenderSnapshot.h"
+#include "Helper.h"
+
+/**
+ * Frozen block state of a World - see World::take_snapshot().
+ */
+class WorldSnapshot
+{
+	friend class World;
+
+	BlockGridSnapshot blocks_;
+	unsigned int seed_;
+};
+
+/**
+ * First block hit by a rectangle (or ray) swept through the world - see World::blocks_sweep_rectangle().
+ */
+struct BlockSweepHit
+{
+	BlockRef block; // empty if nothing was hit
+	sf::Vector2<uint32_t> pos;
+	float t; // fraction of the motion made before the hit, in [0, 1]
+};
+
+/**
+ * First entity hit by a rectangle swept through the world - see World::entity_sweep_rectangle().
+ */
+struct EntitySweepHit
+{
+	EntityId id; // Entity::INVALID_ENTITY_ID if nothing was hit
+	float t; // fraction of the motion made before the hit, in [0, 1]
+	sf::FloatRect rect; // of the entity hit, as of the start of the tick
+};
 
 class World
 {
-	const std::vector<sf::Texture>* explosion_anim_textures_;
+public:
+	// wall-clock time per snapshot spent shading marked blocks into the blocks layer before leaving the rest for later ones
+	static const sf::Time BLOCKS_TEXTURE_UPDATE_BUDGET;
+
+	// backlogs of blocks marked for a texture update that kept any of them from being redrawn for this long are logged
+	static const sf::Time BLOCKS_TEXTURE_BACKLOG_REPORT_LATENCY;
+
+	// size of the cells of the broadphase grid used for entity collision queries
+	static const float ENTITY_GRID_CELL_SIZE;
+
+	// fewest entities worth handing to a job of their own in tick()
+	static const std::size_t MIN_ENTITIES_PER_TICK_RANGE = 64;
 
-	std::vector<std::unique_ptr<Block>> blocks_;
-	uint32_t blocks_width_, blocks_height_;
-	std::queue<sf::Vector2<uint32_t>> blocks_marked_for_state_update_;
-	std::vector<sf::Vector2<uint32_t>> blocks_marked_for_texture_update_;
+private:
+	unsigned int seed_;
+
+	// runs generation, entity ticks and block layer shading in parallel - everything runs on the calling thread without one
+	JobSystem* jobs_;
 
-	sf::RenderTexture blocks_render_texture_;
+	BlockGrid blocks_;
+	BlockDirtyMap blocks_marked_for_state_update_;
+	BlockUpdateScheduler blocks_marked_for_texture_update_;
+
+	BlockLayer blocks_layer_;
 	bool update_blocks_render_texture_;
 
-	std::unordered_map<EntityId, std::unique_ptr<Entity>> entities_;
-	std::vector<EntityId> entities_non_fx_;
-	EntityId entities_next_id_;
+	// background world generation state - see begin_generate_new_world()
+	std::shared_ptr<const WorldCache> world_cache_;
+	JobSystem::JobHandle generation_job_;
+	std::unique_ptr<BlockGrid> generation_blocks_;
+	unsigned int generation_seed_;
+	std::atomic<uint32_t> generation_columns_filled_;
+	std::atomic<bool> generation_finished_;
+	bool is_generating_, generation_swapped_;
+	uint32_t generation_refresh_chunks_total_, generation_refresh_chunks_done_;
 
-	void remove_entity(decltype(entities_)::iterator it);
+	// indexed by EntityPool::get_next_type_index() of each entity type - declared first so that they outlive the entities
+	std::vector<std::unique_ptr<EntityPool>> entity_pools_;
+	EntitySlotMap entities_;
+	EntityGrid entity_grid_; // non-fx entities only
+	ParticleSystem particles_;
 
-	inline std::size_t get_block_index(uint32_t x, uint32_t y)
-	{
-		if (x >= blocks_width_ || y >= blocks_height_)
-			throw std::runtime_error("Block index out of range");
+	// requested by explode_at() over the current tick
+	ExplosionQueue explosions_;
 
-		return x + (blocks_width_ * y);
-	}
+	// one per range of entities ticked, applied in order once they have all finished
+	std::vector<WorldCommandBuffer> tick_command_buffers_;
+
+	// scratch space for the chunks shaded by shade_chunks()
+	std::vector<sf::Vector2<uint32_t>> shade_chunk_positions_;
+
+	// scratch space for the cells that may throw out gibs in resolve_explosions()
+	std::vector<sf::Vector2<uint32_t>> explosion_gib_cells_;
+
+	void remove_entity_at(std::size_t index);
+	void clear_entities();
 
-	void update_blocks_render_texture(uint32_t x, uint32_t y);
+	// applies every explosion requested since the last call at once
+	void resolve_explosions();
+
+	// ticks every entity, split into contiguous ranges that run as jobs, then applies their commands
+	void tick_entities();
+
+	// waits for a generation started by begin_generate_new_world() to finish
+	void finish_generation_job();
+
+	// reshades the chunks at the given positions into the blocks layer, in parallel, and marks them as no longer dirty
+	void shade_chunks(const std::vector<sf::Vector2<uint32_t>>& chunk_positions);
+
+	// same as blocks_test_rectangle_collision(), but over the cells in [x_begin, x_end) x [y_begin, y_end), which are clamped to the world
+	std::pair<BlockRef, sf::Vector2<uint32_t>> blocks_test_cells(int64_t x_begin, int64_t y_begin, int64_t x_end, int64_t y_end, BlockTypeMask type_mask);
+
+	template <typename T>
+	EntityPool& get_entity_pool();
 
 public:
-	static const uint32_t MAX_BLOCKS_TEXTURE_UPDATES_PER_RENDER = 3000;
-	static const uint32_t MAX_BLOCKS_TEXTURE_UPDATES_FOR_CATCHUP = 8 * MAX_BLOCKS_TEXTURE_UPDATES_PER_RENDER;
 
 	World(uint32_t blocks_width, uint32_t blocks_height);
 	~World();
 
-	void refresh_blocks_render_texture();
+	/**
+	 * Reshades chunks of the blocks layer that have been modified since the last refresh, up to max_chunks of them.
+	 * Returns true if there are no more dirty chunks left to reshade.
+	 */
+	bool refresh_blocks_layer(uint32_t max_chunks = std::numeric_limits<uint32_t>::max());
 
 	void clear();
+
+	// generates a new world, blocking until it is ready
 	void generate_new_world(unsigned int seed);
 
+	/**
+	 * Starts generating a new world as a background job. The current world is left untouched (and can keep ticking) until
+	 * update_generate_new_world() swaps the new one in. Without a job system, the world is generated before this returns.
+	 * If a world cache is set, the world is loaded from it instead if it was generated before, or saved to it otherwise.
+	 */
+	void begin_generate_new_world(unsigned int seed);
+
+	/**
+	 * Should be called every frame while generating. Swaps in the new world (removing all entities) once the background job
+	 * is done with it, then redraws its texture max_refresh_chunks chunks at a time so that no single frame stalls.
+	 * Returns true once the new world is fully ready (or if no generation is in progress).
+	 */
+	bool update_generate_new_world(uint32_t max_refresh_chunks = std::numeric_limits<uint32_t>::max());
+
+	inline bool is_generating_new_world() const { return is_generating_; }
+
+	// progress of the current generation from 0 to 1
+	float get_generation_progress() const;
+
+	/**
+	 * Freezes the current blocks and blocks render texture so that the world can be cheaply reset back to them later.
+	 * Block chunks are shared with the snapshot and only copied once an explosion (or anything else) writes to them.
+	 */
+	std::shared_ptr<const WorldSnapshot> take_snapshot();
+
+	/**
+	 * Resets the blocks back to the state of the snapshot and removes all entities.
+	 * Only the chunks that were modified since the snapshot are restored (and redrawn).
+	 */
+	void restore_snapshot(const WorldSnapshot& snapshot);
+
 	inline void mark_block_for_update(uint32_t x, uint32_t y)
 	{
-		blocks_marked_for_state_update_.emplace(x, y);
+		blocks_.set_chunk_dirty(x >> BlockChunk::SIZE_SHIFT, y >> BlockChunk::SIZE_SHIFT, true);
+		blocks_marked_for_state_update_.mark(x, y);
 		if (update_blocks_render_texture_)
-			blocks_marked_for_texture_update_.emplace_back(x, y);
+			blocks_marked_for_texture_update_.mark(x, y);
 	}
 
+	// same as mark_block_for_update() for the cells of the given bits of row y of a chunk
+	inline void mark_blocks_for_update(uint32_t chunk_x, uint32_t y, uint64_t row_bits)
+	{
+		blocks_.set_chunk_dirty(chunk_x, y >> BlockChunk::SIZE_SHIFT, true);
+		blocks_marked_for_state_update_.mark_tile_row(chunk_x, y, row_bits);
+		if (update_blocks_render_texture_)
+			blocks_marked_for_texture_update_.mark_tile_row(chunk_x, y, row_bits);
+	}
+
+	/**
+	 * Entities tick against the world as it was at the start of the tick - they only change their own state, and record
+	 * everything else they do into a WorldCommandBuffer that is applied once all of them are done. This lets them tick on
+	 * several threads while the result stays the same no matter how many are used.
+	 */
 	void tick();
-	void render(sf::RenderTarget& target);
+
+	/**
+	 * Fills in the blocks layer patches, entities and particles of a snapshot of the world as of the end of the last tick.
+	 * Blocks marked for a texture update are shaded first, within BLOCKS_TEXTURE_UPDATE_BUDGET and starting with the ones in
+	 * visible_rect (in world coordinates), so that only their patches have to be copied.
+	 */
+	void fill_render_snapshot(RenderSnapshot& snapshot, const sf::FloatRect& visible_rect);
+
+	/**
+	 * Jobs of the world are run on the given job system, which must outlive the world - or on the calling thread if null.
+	 * Must not be changed while a world is being generated.
+	 */
+	inline void set_job_system(JobSystem* jobs) { jobs_ = jobs; }
+	inline JobSystem* get_job_system() const { return jobs_; }
 
 	inline float get_gravity_accel() const { return 4.5f; }
 
-	EntityId add_entity(std::unique_ptr<Entity>& entity);
+	/**
+	 * Constructs an entity of type T in place, in a pool of entities of that type, and adds it to the world.
+	 * The entity's get_id() is its handle. Returns the entity so that it can be set up before its first tick.
+	 */
+	template <typename T, typename... Args>
+	T* emplace_entity(Args&&... args);
+
 	Entity* get_entity(EntityId id);
-	inline void remove_entity(EntityId id) { remove_entity(entities_.find(id)); }
+	void remove_entity(EntityId id);
+
+	// fx-only particles - cleared along with the entities
+	inline ParticleSystem& get_particles() { return particles_; }
 	
+	/**
+	 * Requests an explosion, which is applied at the end of the tick along with every other one requested during it.
+	 * Overlapping explosions are merged, so each block is only damaged once no matter how many hit it.
+	 */
 	void explode_at(uint32_t x, uint32_t y, uint16_t r, uint32_t center_damage, double gib_chance = 0.2);
 
 	/**
-	 * Returns a pair with a pointer to the block and its x and y pos if the rectangle intersects with it.
-	 * Returns nullptr Block if no collision.
+	 * Returns a pair with a handle to the block and its x and y pos if the rectangle intersects with a solid block of a type in the mask.
+	 * Returns an empty BlockRef if no collision.
 	 */
-	std::pair<Block*, sf::Vector2<uint32_t>> blocks_test_rectangle_collision(sf::FloatRect rect);
+	std::pair<BlockRef, sf::Vector2<uint32_t>> blocks_test_rectangle_collision(sf::FloatRect rect, BlockTypeMask type_mask = Block::BLOCK_TYPE_MASK_ALL);
 
 	/**
-	 * Returns the ID of the entity the rectangle collided with, otherwise Entity::INVALID_ENTITY_ID
-	 * Does not test fx-only entities.
+	 * Returns the first solid block of a type in the mask that the rectangle hits when moved by delta, and how far along it was hit.
+	 * Only the cells that the leading edges of the rectangle enter along the way are tested (in the order they are entered), so
+	 * fast movers can't tunnel through thin walls and the cost scales with the distance moved rather than the swept area.
 	 */
-	EntityId entity_test_rectangle_collision(sf::FloatRect rect);
+	BlockSweepHit blocks_sweep_rectangle(sf::FloatRect rect, sf::Vector2f delta, BlockTypeMask type_mask = Block::BLOCK_TYPE_MASK_ALL);
+
+	// same as blocks_sweep_rectangle() for a point - a grid traversal of the cells along the segment from origin to origin + delta
+	inline BlockSweepHit blocks_raycast(sf::Vector2f origin, sf::Vector2f delta, BlockTypeMask type_mask = Block::BLOCK_TYPE_MASK_ALL)
+	{
+		return blocks_sweep_rectangle(sf::FloatRect(origin, sf::Vector2f()), delta, type_mask);
+	}
 
-	Block* create_block_at(uint32_t x, uint32_t y, BlockType type);
+	/**
+	 * Returns the ID of an entity of a type in the mask that the rectangle collided with, otherwise Entity::INVALID_ENTITY_ID.
+	 * The entity with exclude_id (e.g the one asking) is never returned.
+	 * Does not test fx-only entities, or entities marked for deletion. Entities are tested where they were at the start of the tick.
+	 */
+	EntityId entity_test_rectangle_collision(sf::FloatRect rect, EntityTypeMask type_mask = Entity::ENTITY_TYPE_MASK_ALL,
+		EntityId exclude_id = Entity::INVALID_ENTITY_ID);
+
+	/**
+	 * Same as entity_test_rectangle_collision(), but for the rectangle moved by delta (treating the other entities as still).
+	 * Returns the entity hit first and how far along it was hit.
+	 */
+	EntitySweepHit entity_sweep_rectangle(sf::FloatRect rect, sf::Vector2f delta, EntityTypeMask type_mask = Entity::ENTITY_TYPE_MASK_ALL,
+		EntityId exclude_id = Entity::INVALID_ENTITY_ID);
+
+	// same as entity_sweep_rectangle(), but appends every entity hit to out_hits in the order they're hit and returns how many
+	std::size_t entity_sweep_rectangle_hits(sf::FloatRect rect, sf::Vector2f delta, std::vector<EntitySweepHit>& out_hits,
+		EntityTypeMask type_mask = Entity::ENTITY_TYPE_MASK_ALL, EntityId exclude_id = Entity::INVALID_ENTITY_ID);
+
+	// same as entity_test_rectangle_collision(), but appends the IDs of every entity collided with to out_ids and returns how many
+	std::size_t entity_test_rectangle_collisions(sf::FloatRect rect, std::vector<EntityId>& out_ids,
+		EntityTypeMask type_mask = Entity::ENTITY_TYPE_MASK_ALL, EntityId exclude_id = Entity::INVALID_ENTITY_ID);
+
+	BlockRef create_block_at(uint32_t x, uint32_t y, BlockType type);
 	void remove_block_at(uint32_t x, uint32_t y);
 
-	inline void set_block_at(uint32_t x, uint32_t y, std::unique_ptr<Block>& block) { blocks_[get_block_index(x, y)] = std::move(block); }
+	/**
+	 * Fills the cells in [x_begin, x_end) x [y_begin, y_end) with new blocks of the given type - see BlockGrid::fill_rect().
+	 * Unlike calling create_block_at() for each cell, the region is only marked for a texture update a row at a time.
+	 */
+	void fill_rect(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end, BlockType type, bool only_empty = false);
+
+	inline BlockRef set_block_at(uint32_t x, uint32_t y, const Block& block)
+	{
+		const auto block_ref = blocks_.set_block_at(x, y, block);
+		mark_block_for_update(x, y);
+		return block_ref;
+	}
+
+	inline BlockRef get_block_at(uint32_t x, uint32_t y) { return blocks_.get_block_at(x, y); }
+
+	inline sf::Uint8 get_block_color_noise(uint32_t x, uint32_t y) const { return BlockLayer::get_color_noise(x, y, seed_); }
 
-	inline Block* get_block_at(uint32_t x, uint32_t y) { return blocks_[get_block_index(x, y)].get(); }
-	inline const Block* get_block_at(uint32_t x, uint32_t y) const { return get_block_at(x, y); }
+	inline sf::Color get_block_color_at(uint32_t x, uint32_t y) { return get_block_at(x, y).get_color(get_block_color_noise(x, y)); }
 
-	inline uint32_t get_blocks_width() const { return blocks_width_; }
-	inline uint32_t get_blocks_height() const { return blocks_height_; }
+	/**
+	 * Returns the y of the topmost block in column x, or the height of the world if the column is empty.
+	 * Blocks destroyed since the last tick still count until the tick removes them.
+	 */
+	inline uint32_t get_column_top(uint32_t x) const { return blocks_.get_column_top(x); }
+	inline uint32_t get_highest_column_top(uint32_t x_begin, uint32_t x_end) const { return blocks_.get_highest_column_top(x_begin, x_end); }
+
+	inline uint32_t get_blocks_width() const { return blocks_.get_width(); }
+	inline uint32_t get_blocks_height() const { return blocks_.get_height(); }
+
+	inline unsigned int get_seed() const { return seed_; }
 
 	inline void set_update_blocks_render_texture(bool val) { update_blocks_render_texture_ = val; }
 	inline bool get_update_blocks_render_texture() const { return update_blocks_render_texture_; }
 
-	inline void set_explosion_anim_textures(const std::vector<sf::Texture>* anim_frames) { explosion_anim_textures_ = anim_frames; }
-	inline const std::vector<sf::Texture>* get_explosion_anim_textures() const { return explosion_anim_textures_; }
+	// null disables caching of generated worlds
+	inline void set_world_cache(const std::shared_ptr<const WorldCache>& world_cache) { world_cache_ = world_cache; }
+	inline const std::shared_ptr<const WorldCache>& get_world_cache() const { return world_cache_; }
 };
 
+template <typename T>
+EntityPool& World::get_entity_pool()
+{
+	static const std::size_t type_index = EntityPool::get_next_type_index();
+	if (type_index >= entity_pools_.size())
+		entity_pools_.resize(type_index + 1);
+
+	auto& pool = entity_pools_[type_index];
+	if (!pool)
+		pool = std::make_unique<EntityPool>(sizeof(T));
+
+	return *pool;
+}
+
+template <typename T, typename... Args>
+T* World::emplace_entity(Args&&... args)
+{
+	static_assert(std::is_base_of<Entity, T>::value, "only entities can be emplaced into the world");
+
+	auto& pool = get_entity_pool<T>();
+	void* const slot = pool.allocate();
+	T* entity;
+	try {
+		entity = new (slot) T(std::forward<Args>(args)...);
+	}
+	catch (...) {
+		// the entity never came to be, so only its slot needs handing back
+		pool.deallocate(slot);
+		throw;
+	}
+
+	const auto id = entities_.insert(PooledEntityPtr(entity, EntityPool::Deleter{ &pool }));
+	//printf("Adding entity %d (%s) to world\n", static_cast<int>(id), entity->get_name());
+
+	entity->assign_world(this, id);
+	return entity;
+}
+
+/**
+ * Tunables of WorldGen. The generated world is a pure function of these, the seed and the world dimensions.
+ */
+struct WorldGenParams
+{
+	// as fractions of the world height
+	float terrain_y_top_min, terrain_y_top_max;
+	int8_t terrain_y_step_min, terrain_y_step_max;
+	double terrain_y_step_change_chance;
+
+	uint32_t building_x_min, building_x_max, building_y_min, building_y_max;
+	uint32_t building_foundation_size, building_middle_clearance;
+	double building_gen_chance;
+
+	WorldGenParams();
+
+	/**
+	 * Hash of every parameter and WorldGen::GENERATOR_VERSION - worlds generated with the same hash (and seed and dimensions)
+	 * are identical.
+	 */
+	uint32_t get_hash() const;
+};
+
+/**
+ * Generates the blocks of a world from a seed.
+ * Every random decision is drawn from a stateless per-column stream (a hash of the seed, column and stream), so the surface and
+ * building placement can be planned up-front and the grid then filled in parallel bands - output is identical for a given seed
+ * regardless of the amount of threads used.
+ */
 class WorldGen
 {
-	World& world_;
+	struct BuildingPlacement
+	{
+		uint32_t x, width, height, bottom;
+	};
+
+	enum RandomStream : uint32_t
+	{
+		RANDOM_STREAM_TERRAIN_START,
+		RANDOM_STREAM_TERRAIN_STEP_CHANCE,
+		RANDOM_STREAM_TERRAIN_STEP,
+		RANDOM_STREAM_BUILDING_CHANCE,
+		RANDOM_STREAM_BUILDING_WIDTH,
+		RANDOM_STREAM_BUILDING_HEIGHT
+	};
+
+	BlockGrid& blocks_;
 	unsigned int seed_;
-	std::mt19937 rng_;
+	WorldGenParams params_;
+	JobSystem* jobs_;
+	std::atomic<uint32_t>* columns_filled_;
+
+	std::vector<uint32_t> terrain_tops_;
+	std::vector<BuildingPlacement> buildings_;
+
+	inline uint32_t get_column_random(uint32_t x, RandomStream stream) const { return Helper::hash_coords(x, stream, seed_); }
+	inline int get_column_random_int(uint32_t x, RandomStream stream, int min, int max) const
+	{
+		return min + static_cast<int>(get_column_random(x, stream) % static_cast<uint32_t>(max - min + 1));
+	}
+	inline bool get_column_random_bool(uint32_t x, RandomStream stream, double true_chance) const
+	{
+		return (get_column_random(x, stream) / 4294967296.0) < true_chance;
+	}
 
+	// these plan the terrain surface and building placement - fill_band does the actual block creation
 	void gen_terrain(uint32_t y_top_min, uint32_t y_top_max, int8_t y_step_min, int8_t y_step_max, double y_step_change_chance);
 	void gen_buildings(uint32_t building_x_min, uint32_t building_x_max, uint32_t building_y_min, uint32_t building_y_max, 
 		uint32_t building_foundation_size, uint32_t middle_clearance, double building_gen_chance);
 
+	uint32_t get_terrain_layer_end(uint32_t y_top, float depth) const;
+
+	// fills the planned terrain and buildings within [x_begin, x_end) a run of blocks at a time
+	void fill_band(uint32_t x_begin, uint32_t x_end);
+
 public:
-	WorldGen(World& world, unsigned int seed);
+	// must be bumped whenever a change to the generation code changes its output, as this invalidates cached worlds
+	static const uint32_t GENERATOR_VERSION = 1;
+
+	/**
+	 * Bands of the world are filled as jobs of the given job system, or all on the calling thread if it's null.
+	 * If columns_filled is not null, it is incremented as each column of terrain is filled so progress can be reported.
+	 */
+	WorldGen(BlockGrid& blocks, unsigned int seed, const WorldGenParams& params = WorldGenParams(), JobSystem* jobs = nullptr,
+		std::atomic<uint32_t>* columns_filled = nullptr);
 	~WorldGen();
 
 	void generate_world();
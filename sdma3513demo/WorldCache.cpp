@@ -0,0 +1,346 @@
+#include "WorldCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <type_traits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(std::is_trivially_copyable<BlockChunk>::value, "BlockChunk must be trivially copyable to be stored in a WorldCache file");
+
+
+namespace
+{
+	const char FILE_MAGIC[4] = { 'S', 'D', 'W', 'C' };
+	const uint32_t FILE_BYTE_ORDER_MARK = 0x01020304;
+
+	// chunks start on a cache line so that adopting them in place doesn't leave them misaligned
+	const uint64_t FILE_CHUNKS_ALIGNMENT = 64;
+
+	struct WorldCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t byte_order_mark;
+		uint32_t chunk_size;
+
+		uint32_t width, height;
+		uint32_t seed;
+		uint32_t params_hash;
+
+		uint32_t chunk_count; // allocated chunks stored in the file
+		uint32_t padding;
+
+		uint64_t column_tops_offset; // uint32_t per column
+		uint64_t chunk_indices_offset; // uint32_t per stored chunk, in increasing order
+		uint64_t chunks_offset; // BlockChunk per stored chunk
+		uint64_t file_size;
+	};
+
+	/**
+	 * Returns whether every cell of a chunk read from a file has a valid type and health, and whether its block count and
+	 * bitplanes agree with its cells - BlockChunk indexes its bitplanes by type, so a bad type byte would write out of bounds.
+	 */
+	bool is_chunk_valid(const BlockChunk& chunk)
+	{
+		uint32_t block_count = 0;
+		for (uint32_t row = 0; row < BlockChunk::SIZE; ++row) {
+			uint64_t occupied_bits = 0, solid_bits = 0;
+			uint64_t type_bits[Block::BLOCK_TYPE_COUNT] = {};
+
+			for (uint32_t x = 0; x < BlockChunk::SIZE; ++x) {
+				const auto i = BlockChunk::get_cell_index(x, row);
+				const auto bit = BlockChunk::get_cell_bit(i);
+				const auto type = chunk.types[i];
+				const auto health = chunk.healths[i];
+
+				if (type == BlockType::None) {
+					if (health != 0)
+						return false;
+
+					continue;
+				}
+
+				if (static_cast<uint32_t>(type) >= Block::BLOCK_TYPE_COUNT || health > Block::get_block_max_health(type))
+					return false;
+
+				++block_count;
+				occupied_bits |= bit;
+				type_bits[static_cast<uint32_t>(type)] |= bit;
+				if (health > 0)
+					solid_bits |= bit;
+			}
+
+			if (chunk.occupied_rows[row] != occupied_bits || chunk.solid_rows[row] != solid_bits)
+				return false;
+
+			for (uint32_t type = 0; type < Block::BLOCK_TYPE_COUNT; ++type) {
+				if (chunk.type_rows[type][row] != type_bits[type])
+					return false;
+			}
+		}
+
+		return chunk.block_count == block_count;
+	}
+
+	/**
+	 * Read-only file mapped copy-on-write: pages can be written to, but the writes are private to the process and never reach the file.
+	 */
+	class MappedFile
+	{
+		uint8_t* data_;
+		std::size_t size_;
+
+	public:
+		MappedFile() : data_(nullptr), size_(0) { }
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+			if (!data_)
+				return;
+
+#ifdef _WIN32
+			UnmapViewOfFile(data_);
+#else
+			munmap(data_, size_);
+#endif
+		}
+
+		bool open(const std::string& path)
+		{
+#ifdef _WIN32
+			const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) {
+				CloseHandle(file);
+				return false;
+			}
+
+			const auto mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+			CloseHandle(file);
+			if (!mapping)
+				return false;
+
+			// the view keeps the mapping alive on its own
+			data_ = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+			CloseHandle(mapping);
+			if (!data_)
+				return false;
+
+			size_ = static_cast<std::size_t>(file_size.QuadPart);
+#else
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			struct stat file_stat;
+			if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+				close(fd);
+				return false;
+			}
+
+			const auto size = static_cast<std::size_t>(file_stat.st_size);
+			void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (data == MAP_FAILED)
+				return false;
+
+			data_ = static_cast<uint8_t*>(data);
+			size_ = size;
+#endif
+			return true;
+		}
+
+		inline uint8_t* get_data() const { return data_; }
+		inline std::size_t get_size() const { return size_; }
+	};
+
+	inline uint64_t align_offset(uint64_t offset, uint64_t alignment) { return (offset + alignment - 1) & ~(alignment - 1); }
+
+	void make_directory(const std::string& path)
+	{
+		// fails harmlessly if it already exists
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+}
+
+
+WorldCache::WorldCache(const std::string& directory) :
+	directory_(directory)
+{
+}
+
+
+WorldCache::~WorldCache()
+{
+}
+
+
+std::string WorldCache::get_file_path(uint32_t width, uint32_t height, unsigned int seed, uint32_t params_hash) const
+{
+	std::ostringstream oss;
+	oss << directory_ << "/world_" << width << "x" << height << "_" << seed << "_" << std::hex << std::setw(8) << std::setfill('0') << params_hash << ".sdw";
+	return oss.str();
+}
+
+
+bool WorldCache::load(BlockGrid& blocks, unsigned int seed, uint32_t params_hash) const
+{
+	const auto path = get_file_path(blocks.get_width(), blocks.get_height(), seed, params_hash);
+
+	auto file = std::make_shared<MappedFile>();
+	if (!file->open(path))
+		return false;
+
+	if (file->get_size() < sizeof(WorldCacheHeader)) {
+		fprintf(stderr, "World cache file \"%s\" is truncated - ignoring it.\n", path.c_str());
+		return false;
+	}
+
+	WorldCacheHeader header;
+	std::memcpy(&header, file->get_data(), sizeof(header));
+
+	const auto total_chunk_count = static_cast<uint64_t>(blocks.get_chunks_width()) * blocks.get_chunks_height();
+	if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header.version != FILE_VERSION ||
+		header.byte_order_mark != FILE_BYTE_ORDER_MARK || header.chunk_size != sizeof(BlockChunk) ||
+		header.width != blocks.get_width() || header.height != blocks.get_height() || header.seed != seed || header.params_hash != params_hash ||
+		header.chunk_count > total_chunk_count || header.file_size != file->get_size() ||
+		header.column_tops_offset + (sizeof(uint32_t) * static_cast<uint64_t>(header.width)) > header.file_size ||
+		header.chunk_indices_offset + (sizeof(uint32_t) * static_cast<uint64_t>(header.chunk_count)) > header.file_size ||
+		header.chunks_offset % FILE_CHUNKS_ALIGNMENT != 0 ||
+		header.chunks_offset + (sizeof(BlockChunk) * static_cast<uint64_t>(header.chunk_count)) > header.file_size) {
+		fprintf(stderr, "World cache file \"%s\" is invalid or from a different build - ignoring it.\n", path.c_str());
+		return false;
+	}
+
+	std::vector<uint32_t> column_tops(header.width);
+	std::memcpy(column_tops.data(), file->get_data() + header.column_tops_offset, sizeof(uint32_t) * column_tops.size());
+	for (const auto column_top : column_tops) {
+		if (column_top > header.height) {
+			fprintf(stderr, "World cache file \"%s\" has invalid column tops - ignoring it.\n", path.c_str());
+			return false;
+		}
+	}
+
+	// chunks alias the mapping, which lives for as long as any of them do
+	std::vector<std::shared_ptr<BlockChunk>> chunks(static_cast<std::size_t>(total_chunk_count));
+	int64_t last_chunk_index = -1;
+	for (uint32_t n = 0; n < header.chunk_count; ++n) {
+		uint32_t chunk_index;
+		std::memcpy(&chunk_index, file->get_data() + header.chunk_indices_offset + (sizeof(uint32_t) * n), sizeof(chunk_index));
+		if (chunk_index <= last_chunk_index || chunk_index >= total_chunk_count) {
+			fprintf(stderr, "World cache file \"%s\" has an invalid chunk table - ignoring it.\n", path.c_str());
+			return false;
+		}
+
+		last_chunk_index = chunk_index;
+		const auto chunk = reinterpret_cast<BlockChunk*>(file->get_data() + header.chunks_offset + (sizeof(BlockChunk) * n));
+		if (!is_chunk_valid(*chunk)) {
+			fprintf(stderr, "World cache file \"%s\" has an invalid chunk - ignoring it.\n", path.c_str());
+			return false;
+		}
+
+		chunks[chunk_index] = std::shared_ptr<BlockChunk>(file, chunk);
+	}
+
+	blocks.assign_chunks(std::move(chunks), std::move(column_tops));
+	printf("Loaded world from cache file \"%s\" (%d chunks).\n", path.c_str(), static_cast<int>(header.chunk_count));
+	return true;
+}
+
+
+bool WorldCache::save(const BlockGrid& blocks, unsigned int seed, uint32_t params_hash) const
+{
+	std::vector<uint32_t> chunk_indices;
+	for (uint32_t chunk_y = 0; chunk_y < blocks.get_chunks_height(); ++chunk_y) {
+		for (uint32_t chunk_x = 0; chunk_x < blocks.get_chunks_width(); ++chunk_x) {
+			if (blocks.get_chunk(chunk_x, chunk_y))
+				chunk_indices.push_back(chunk_x + (blocks.get_chunks_width() * chunk_y));
+		}
+	}
+
+	std::vector<uint32_t> column_tops(blocks.get_width());
+	for (uint32_t x = 0; x < blocks.get_width(); ++x)
+		column_tops[x] = blocks.get_column_top(x);
+
+	WorldCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+	header.version = FILE_VERSION;
+	header.byte_order_mark = FILE_BYTE_ORDER_MARK;
+	header.chunk_size = sizeof(BlockChunk);
+	header.width = blocks.get_width();
+	header.height = blocks.get_height();
+	header.seed = seed;
+	header.params_hash = params_hash;
+	header.chunk_count = static_cast<uint32_t>(chunk_indices.size());
+	header.column_tops_offset = sizeof(header);
+	header.chunk_indices_offset = header.column_tops_offset + (sizeof(uint32_t) * column_tops.size());
+	header.chunks_offset = align_offset(header.chunk_indices_offset + (sizeof(uint32_t) * chunk_indices.size()), FILE_CHUNKS_ALIGNMENT);
+	header.file_size = header.chunks_offset + (sizeof(BlockChunk) * static_cast<uint64_t>(chunk_indices.size()));
+
+	make_directory(directory_);
+	const auto path = get_file_path(header.width, header.height, seed, params_hash);
+	const auto temp_path = path + ".tmp";
+
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			fprintf(stderr, "Failed to create world cache file \"%s\"!\n", temp_path.c_str());
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(column_tops.data()), sizeof(uint32_t) * column_tops.size());
+		file.write(reinterpret_cast<const char*>(chunk_indices.data()), sizeof(uint32_t) * chunk_indices.size());
+
+		const char padding[FILE_CHUNKS_ALIGNMENT] = { };
+		file.write(padding, static_cast<std::streamsize>(header.chunks_offset - (header.chunk_indices_offset + (sizeof(uint32_t) * chunk_indices.size()))));
+
+		for (const auto chunk_index : chunk_indices) {
+			const auto chunk = blocks.get_chunk(chunk_index % blocks.get_chunks_width(), chunk_index / blocks.get_chunks_width());
+			file.write(reinterpret_cast<const char*>(chunk), sizeof(BlockChunk));
+		}
+
+		if (!file) {
+			fprintf(stderr, "Failed to write world cache file \"%s\"!\n", temp_path.c_str());
+			file.close();
+			std::remove(temp_path.c_str());
+			return false;
+		}
+	}
+
+	// only replace the old file once the new one is complete, so a crash never leaves a half-written world behind
+	std::remove(path.c_str());
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+		fprintf(stderr, "Failed to move world cache file \"%s\" into place!\n", temp_path.c_str());
+		std::remove(temp_path.c_str());
+		return false;
+	}
+
+	printf("Saved world to cache file \"%s\" (%d chunks).\n", path.c_str(), static_cast<int>(header.chunk_count));
+	return true;
+}
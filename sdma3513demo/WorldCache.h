@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "BlockGrid.h"
+
+/**
+ * On-disk cache of generated worlds, keyed by their dimensions, seed and WorldGenParams hash.
+ *
+ * A cache file is a header followed by the column tops and the allocated chunks of the BlockGrid, stored exactly as they are
+ * laid out in memory. Loading maps the file copy-on-write and hands the chunks straight to the grid without parsing them,
+ * so they are only ever read in (and copied) by the OS once they are touched. Files are tied to the build that wrote them -
+ * one with a different chunk layout or byte order is treated as a miss.
+ */
+class WorldCache
+{
+	std::string directory_;
+
+public:
+	static const uint32_t FILE_VERSION = 1;
+
+	explicit WorldCache(const std::string& directory);
+	~WorldCache();
+
+	std::string get_file_path(uint32_t width, uint32_t height, unsigned int seed, uint32_t params_hash) const;
+
+	/**
+	 * Replaces the contents of blocks with the cached world if there is one matching the grid's dimensions, the seed and params_hash.
+	 * Returns false (leaving blocks untouched) if there's no such world or the file is not valid.
+	 */
+	bool load(BlockGrid& blocks, unsigned int seed, uint32_t params_hash) const;
+
+	// writes the world to the cache, replacing any existing file for it - returns false on failure
+	bool save(const BlockGrid& blocks, unsigned int seed, uint32_t params_hash) const;
+};
@@ -0,0 +1,159 @@
+#include "WorldCommandBuffer.h"
+
+#include "World.h"
+#include "PlayerTurretEntity.h"
+
+
+WorldCommandBuffer::WorldCommandBuffer()
+{
+}
+
+
+WorldCommandBuffer::~WorldCommandBuffer()
+{
+}
+
+
+WorldCommand& WorldCommandBuffer::push(WorldCommandType type)
+{
+	// commands recorded outside of any group aren't guarded
+	if (groups_.empty())
+		begin_group(Entity::INVALID_ENTITY_ID);
+
+	WorldCommand command = {};
+	command.type = type;
+	command.group = static_cast<uint32_t>(groups_.size() - 1);
+	commands_.push_back(command);
+	return commands_.back();
+}
+
+
+void WorldCommandBuffer::remove_entity(EntityId id)
+{
+	push(WorldCommandType::RemoveEntity).entity_id = id;
+}
+
+
+void WorldCommandBuffer::explode_at(uint32_t x, uint32_t y, uint16_t r, uint32_t center_damage, double gib_chance)
+{
+	auto& command = push(WorldCommandType::Explode);
+	command.x = x;
+	command.y = y;
+	command.r = r;
+	command.amount = center_damage;
+	command.chance = gib_chance;
+}
+
+
+void WorldCommandBuffer::emit_smoke(const sf::FloatRect& rect)
+{
+	push(WorldCommandType::EmitSmoke).rect = rect;
+}
+
+
+void WorldCommandBuffer::emit_explosion(const sf::FloatRect& rect)
+{
+	push(WorldCommandType::EmitExplosion).rect = rect;
+}
+
+
+void WorldCommandBuffer::emit_fire_gib_burst(const sf::FloatRect& rect, const sf::Vector2f& velocity)
+{
+	auto& command = push(WorldCommandType::EmitFireGibBurst);
+	command.rect = rect;
+	command.velocity = velocity;
+}
+
+
+void WorldCommandBuffer::add_player_score(EntityId player_id, int32_t delta)
+{
+	auto& command = push(WorldCommandType::AddPlayerScore);
+	command.entity_id = player_id;
+	command.delta = delta;
+}
+
+
+void WorldCommandBuffer::increment_player_bombs_missed(EntityId player_id)
+{
+	push(WorldCommandType::IncrementPlayerBombsMissed).entity_id = player_id;
+}
+
+
+void WorldCommandBuffer::apply(World& world)
+{
+	// whether the group is dropped, evaluated once as the group is entered - groups without commands are still evaluated in
+	// order, as they decide whether the fallback groups after them are applied
+	uint32_t next_group = 0;
+	bool group_dropped = false;
+	bool chain_applied = false; // whether any group since the last one that isn't a fallback was applied
+
+	for (const auto& command : commands_) {
+		while (next_group <= command.group) {
+			const auto& group = groups_[next_group++];
+
+			if (group.fallback && chain_applied)
+				group_dropped = true;
+			else {
+				if (group.guard_id == Entity::INVALID_ENTITY_ID)
+					group_dropped = false;
+				else {
+					const auto guard = world.get_entity(group.guard_id);
+					group_dropped = !guard || guard->is_marked_for_deletion();
+				}
+
+				chain_applied = !group_dropped;
+			}
+		}
+
+		if (group_dropped)
+			continue;
+
+		switch (command.type) {
+		case WorldCommandType::RemoveEntity: {
+			const auto entity = world.get_entity(command.entity_id);
+			if (entity)
+				entity->mark_for_deletion();
+			break;
+		}
+
+		case WorldCommandType::Explode:
+			world.explode_at(command.x, command.y, command.r, command.amount, command.chance);
+			break;
+
+		case WorldCommandType::EmitSmoke:
+			world.get_particles().emit_smoke(command.rect);
+			break;
+
+		case WorldCommandType::EmitExplosion:
+			world.get_particles().emit_explosion(command.rect);
+			break;
+
+		case WorldCommandType::EmitFireGibBurst:
+			world.get_particles().emit_fire_gib_burst(command.rect, command.velocity);
+			break;
+
+		case WorldCommandType::AddPlayerScore: {
+			const auto player = entity_cast<PlayerTurretEntity>(world.get_entity(command.entity_id));
+			if (player)
+				player->add_to_player_score(command.delta);
+			break;
+		}
+
+		case WorldCommandType::IncrementPlayerBombsMissed: {
+			const auto player = entity_cast<PlayerTurretEntity>(world.get_entity(command.entity_id));
+			if (player)
+				player->increment_player_bombs_missed();
+			break;
+		}
+		}
+	}
+
+	clear();
+}
+
+
+void WorldCommandBuffer::clear()
+{
+	commands_.clear();
+	groups_.clear();
+}
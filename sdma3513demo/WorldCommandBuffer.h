@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <SFML/Graphics/Rect.hpp>
+
+#include "Entity.h"
+
+class World;
+
+enum class WorldCommandType : uint8_t
+{
+	RemoveEntity,
+	Explode,
+	EmitSmoke,
+	EmitExplosion,
+	EmitFireGibBurst,
+	AddPlayerScore,
+	IncrementPlayerBombsMissed
+};
+
+// side effect of an entity's tick on the rest of the world - only the fields used by its type are set
+struct WorldCommand
+{
+	WorldCommandType type;
+	uint32_t group;
+	EntityId entity_id;
+	sf::FloatRect rect;
+	sf::Vector2f velocity;
+	uint32_t x, y, amount;
+	int32_t delta;
+	uint16_t r;
+	double chance;
+};
+
+/**
+ * Side effects recorded by entity ticks, to be applied to the world once every entity has ticked - see World::tick().
+ *
+ * While ticking, entities only change their own state and read the rest of the world as it was at the start of the tick,
+ * so they can tick on any thread. Buffers are applied in entity order, which makes the result the same no matter how
+ * the entities were split between threads.
+ *
+ * Commands are recorded in groups, each only applied if the entity guarding it hasn't been removed by an earlier command by
+ * then. Every entity's commands are guarded by itself, so that a bomb shot down earlier in the tick doesn't also explode.
+ *
+ * Fallback groups are only applied if none of the groups before them (back to the last group that isn't one) were, so an
+ * entity can record what it would do should something it read at the start of the tick be gone by the time it's applied.
+ */
+class WorldCommandBuffer
+{
+	struct Group
+	{
+		EntityId guard_id;
+		bool fallback;
+	};
+
+	std::vector<WorldCommand> commands_;
+	std::vector<Group> groups_;
+
+	WorldCommand& push(WorldCommandType type);
+
+public:
+	WorldCommandBuffer();
+	~WorldCommandBuffer();
+
+	// starts a new group of commands guarded by the entity with the given ID
+	inline void begin_group(EntityId guard_id) { groups_.push_back(Group{ guard_id, false }); }
+
+	// same as begin_group(), but the group is skipped if any of the groups since the last begin_group() are applied
+	inline void begin_fallback_group(EntityId guard_id) { groups_.push_back(Group{ guard_id, true }); }
+
+	void remove_entity(EntityId id);
+	void explode_at(uint32_t x, uint32_t y, uint16_t r, uint32_t center_damage, double gib_chance = 0.2);
+
+	void emit_smoke(const sf::FloatRect& rect);
+	void emit_explosion(const sf::FloatRect& rect);
+	void emit_fire_gib_burst(const sf::FloatRect& rect, const sf::Vector2f& velocity);
+
+	void add_player_score(EntityId player_id, int32_t delta);
+	void increment_player_bombs_missed(EntityId player_id);
+
+	// applies every command in the order they were recorded, then clears them
+	void apply(World& world);
+	void clear();
+
+	inline bool is_empty() const { return commands_.empty(); }
+};
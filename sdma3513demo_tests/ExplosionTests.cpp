@@ -0,0 +1,263 @@
+#include "Tests.h"
+
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+
+#include "World.h"
+#include "ExplosionQueue.h"
+
+
+namespace
+{
+	const uint32_t WORLD_WIDTH = 1024;
+	const uint32_t WORLD_HEIGHT = 576;
+
+	struct Bounds
+	{
+		uint32_t x_begin, y_begin, x_end, y_end;
+	};
+
+	// bounding square of a blast, clamped to the world - empty if the blast misses it
+	Bounds get_blast_bounds(const ExplosionRequest& request)
+	{
+		const auto clamp = [](int64_t pos, uint32_t size) { return static_cast<uint32_t>(std::max(static_cast<int64_t>(0), std::min(pos, static_cast<int64_t>(size)))); };
+
+		return Bounds{
+			clamp(static_cast<int64_t>(request.x) - request.r, WORLD_WIDTH),
+			clamp(static_cast<int64_t>(request.y) - request.r, WORLD_HEIGHT),
+			clamp(static_cast<int64_t>(request.x) + request.r + 1, WORLD_WIDTH),
+			clamp(static_cast<int64_t>(request.y) + request.r + 1, WORLD_HEIGHT)
+		};
+	}
+
+	Bounds get_union_bounds(const Bounds& a, const Bounds& b)
+	{
+		return Bounds{ std::min(a.x_begin, b.x_begin), std::min(a.y_begin, b.y_begin), std::max(a.x_end, b.x_end), std::max(a.y_end, b.y_end) };
+	}
+
+	// damage of a blast to the cell (x, y), or -1 if it's out of its reach
+	int64_t get_blast_damage(const ExplosionRequest& request, uint32_t x, uint32_t y)
+	{
+		const int64_t r_sq = static_cast<int64_t>(request.r) * request.r;
+		const int64_t dx = static_cast<int64_t>(x) - request.x;
+		const int64_t dy = static_cast<int64_t>(y) - request.y;
+		const int64_t inside_r_sq = (dx * dx) + (dy * dy);
+		if (inside_r_sq > r_sq)
+			return -1;
+
+		return static_cast<uint32_t>(request.center_damage * (1.0f - std::max(0.1f, static_cast<float>(inside_r_sq) / r_sq)));
+	}
+
+	// the loop over every block in reach that explode_at() used to run, applied straight away
+	void explode_per_block(World& world, const ExplosionRequest& request)
+	{
+		const auto bounds = get_blast_bounds(request);
+
+		for (uint32_t y = bounds.y_begin; y < bounds.y_end; ++y) {
+			for (uint32_t x = bounds.x_begin; x < bounds.x_end; ++x) {
+				auto block = world.get_block_at(x, y);
+				const auto damage = get_blast_damage(request, x, y);
+
+				if (block && damage >= 0)
+					block.damage(static_cast<uint32_t>(damage));
+			}
+		}
+	}
+
+	// empty cells have a health of 0
+	std::vector<uint32_t> get_healths(World& world, const Bounds& bounds)
+	{
+		std::vector<uint32_t> healths;
+		for (uint32_t y = bounds.y_begin; y < bounds.y_end; ++y) {
+			for (uint32_t x = bounds.x_begin; x < bounds.x_end; ++x) {
+				const auto block = world.get_block_at(x, y);
+				healths.push_back(block ? block.get_health() : 0);
+			}
+		}
+
+		return healths;
+	}
+
+	// the solid block each cell's rectangle first collides with, if any - destroyed blocks must stop being collided with
+	std::vector<sf::Vector2<uint32_t>> get_collisions(World& world, const Bounds& bounds)
+	{
+		std::vector<sf::Vector2<uint32_t>> collisions;
+		for (uint32_t y = bounds.y_begin; y < bounds.y_end; ++y) {
+			for (uint32_t x = bounds.x_begin; x < bounds.x_end; ++x) {
+				const sf::FloatRect cell_rect(x * Block::BLOCK_SIZE.x, y * Block::BLOCK_SIZE.y, Block::BLOCK_SIZE.x, Block::BLOCK_SIZE.y);
+				collisions.push_back(world.blocks_test_rectangle_collision(cell_rect).second);
+			}
+		}
+
+		return collisions;
+	}
+
+	std::unique_ptr<World> create_test_world()
+	{
+		auto world = std::make_unique<World>(WORLD_WIDTH, WORLD_HEIGHT);
+		world->generate_new_world(4321);
+
+		// blocks that can't be damaged, for the blasts to skip over
+		world->fill_rect(150, 350, 250, 450, BlockType::Water);
+		world->fill_rect(300, 400, 350, 500, BlockType::Bedrock);
+		return world;
+	}
+
+	ExplosionRequest get_random_request(std::mt19937& rng, int64_t center_x, int64_t center_y, int64_t spread_x, int64_t spread_y, uint16_t max_r, bool strong)
+	{
+		const auto x = center_x + std::uniform_int_distribution<int64_t>(-spread_x, spread_x)(rng);
+		const auto y = center_y + std::uniform_int_distribution<int64_t>(-spread_y, spread_y)(rng);
+
+		return ExplosionRequest{
+			static_cast<uint32_t>(std::max(x, static_cast<int64_t>(0))),
+			static_cast<uint32_t>(std::max(y, static_cast<int64_t>(0))),
+			static_cast<uint16_t>(std::uniform_int_distribution<int>(1, max_r)(rng)),
+			std::uniform_int_distribution<uint32_t>(1, strong ? 200000 : 2000)(rng),
+			1.0
+		};
+	}
+}
+
+
+bool test_explosion_matches_per_block()
+{
+	auto world = create_test_world();
+	std::mt19937 rng(11);
+
+	for (int i = 0; i < 50; ++i) {
+		const auto request = get_random_request(rng, WORLD_WIDTH / 2, (WORLD_HEIGHT * 3) / 4, WORLD_WIDTH / 2 + 50, WORLD_HEIGHT / 4 + 50,
+			i % 10 == 0 ? 300 : 100, i % 3 == 0);
+
+		const auto bounds = get_blast_bounds(request);
+		if (bounds.x_begin >= bounds.x_end || bounds.y_begin >= bounds.y_end)
+			continue;
+
+		const auto snapshot = world->take_snapshot();
+		world->explode_at(request.x, request.y, request.r, request.center_damage, request.gib_chance);
+		world->tick();
+
+		const auto healths = get_healths(*world, bounds);
+		const auto collisions = get_collisions(*world, bounds);
+
+		world->restore_snapshot(*snapshot);
+		explode_per_block(*world, request);
+		TEST_CHECK(get_healths(*world, bounds) == healths && get_collisions(*world, bounds) == collisions,
+			"explosion %d (x: %u, y: %u, r: %u, center damage: %u) differs from damaging each block in reach", i, request.x, request.y, request.r, request.center_damage);
+
+		world->restore_snapshot(*snapshot);
+	}
+
+	return true;
+}
+
+
+bool test_merged_explosions_match_sequential()
+{
+	auto world = create_test_world();
+	std::mt19937 rng(13);
+
+	for (int i = 0; i < 30; ++i) {
+		// clusters of blasts, most of them overlapping
+		const auto center_x = std::uniform_int_distribution<int64_t>(0, WORLD_WIDTH)(rng);
+		const auto center_y = std::uniform_int_distribution<int64_t>(WORLD_HEIGHT / 3, WORLD_HEIGHT)(rng);
+		const auto request_count = std::uniform_int_distribution<int>(1, 12)(rng);
+
+		std::vector<ExplosionRequest> requests;
+		Bounds bounds = { WORLD_WIDTH, WORLD_HEIGHT, 0, 0 };
+		for (int k = 0; k < request_count; ++k) {
+			const auto request = get_random_request(rng, center_x, center_y, 150, 75, 100, k % 3 == 0);
+			const auto blast_bounds = get_blast_bounds(request);
+			if (blast_bounds.x_begin < blast_bounds.x_end && blast_bounds.y_begin < blast_bounds.y_end) {
+				requests.push_back(request);
+				bounds = get_union_bounds(bounds, blast_bounds);
+			}
+		}
+
+		if (requests.empty())
+			continue;
+
+		// applied together at the end of a tick, against one after another
+		const auto snapshot = world->take_snapshot();
+		for (const auto& request : requests)
+			world->explode_at(request.x, request.y, request.r, request.center_damage, request.gib_chance);
+
+		world->tick();
+
+		const auto healths = get_healths(*world, bounds);
+		const auto collisions = get_collisions(*world, bounds);
+
+		world->restore_snapshot(*snapshot);
+		for (const auto& request : requests)
+			explode_per_block(*world, request);
+
+		TEST_CHECK(get_healths(*world, bounds) == healths && get_collisions(*world, bounds) == collisions, "merged explosions of cluster %d (%u blasts) differ from applying them one after another",
+			i, static_cast<unsigned int>(requests.size()));
+
+		world->restore_snapshot(*snapshot);
+
+		// every cell in reach of a blast must be covered by exactly one region, with the damages of every blast summed
+		const auto bounds_width = bounds.x_end - bounds.x_begin;
+		std::vector<uint32_t> expected_damages(static_cast<std::size_t>(bounds_width) * (bounds.y_end - bounds.y_begin), 0);
+		std::vector<uint8_t> expected_covered(expected_damages.size(), 0);
+
+		for (const auto& request : requests) {
+			const auto blast_bounds = get_blast_bounds(request);
+			for (uint32_t y = blast_bounds.y_begin; y < blast_bounds.y_end; ++y) {
+				for (uint32_t x = blast_bounds.x_begin; x < blast_bounds.x_end; ++x) {
+					const auto damage = get_blast_damage(request, x, y);
+					if (damage >= 0) {
+						const auto i_cell = (static_cast<std::size_t>(y - bounds.y_begin) * bounds_width) + (x - bounds.x_begin);
+						expected_damages[i_cell] = std::min(expected_damages[i_cell] + std::min(static_cast<uint32_t>(damage), 0xFFFFu), 0xFFFFu);
+						expected_covered[i_cell] = 1;
+					}
+				}
+			}
+		}
+
+		ExplosionQueue queue;
+		for (const auto& request : requests)
+			queue.push(request);
+
+		std::vector<uint32_t> damages(expected_damages.size(), 0);
+		std::vector<uint8_t> covered(expected_covered.size(), 0);
+		std::size_t covered_outside_count = 0, covered_twice_count = 0;
+
+		queue.resolve(WORLD_WIDTH, WORLD_HEIGHT, [&](const ExplosionQueue::Region& region) {
+			for (uint32_t y = region.y_begin; y < region.y_end; ++y) {
+				for (uint32_t word_x = 0; word_x < region.get_words_width(); ++word_x) {
+					auto covered_bits = region.get_covered_bits(word_x, y);
+
+					while (covered_bits) {
+						const auto bit = Helper::count_trailing_zeros(covered_bits);
+						covered_bits &= covered_bits - 1;
+
+						const auto x = region.x_begin + (word_x << BlockChunk::SIZE_SHIFT) + bit;
+						if (x < bounds.x_begin || x >= bounds.x_end || y < bounds.y_begin || y >= bounds.y_end) {
+							++covered_outside_count;
+							continue;
+						}
+
+						const auto i_cell = (static_cast<std::size_t>(y - bounds.y_begin) * bounds_width) + (x - bounds.x_begin);
+						covered_twice_count += covered[i_cell];
+						covered[i_cell] = 1;
+						damages[i_cell] = region.get_word_damages(word_x, y)[bit];
+					}
+				}
+			}
+		});
+
+		TEST_CHECK(queue.is_empty(), "resolving the queue of cluster %d left requests in it", i);
+		TEST_CHECK(covered_outside_count == 0, "regions of cluster %d cover %u cells out of reach of its blasts", i, static_cast<unsigned int>(covered_outside_count));
+		TEST_CHECK(covered_twice_count == 0, "regions of cluster %d cover %u cells more than once", i, static_cast<unsigned int>(covered_twice_count));
+		TEST_CHECK(covered == expected_covered, "regions of cluster %d don't cover the cells in reach of its blasts", i);
+
+		for (std::size_t i_cell = 0; i_cell < damages.size(); ++i_cell) {
+			if (expected_covered[i_cell])
+				TEST_CHECK(damages[i_cell] == expected_damages[i_cell], "regions of cluster %d have the wrong damage for a cell", i);
+		}
+	}
+
+	return true;
+}
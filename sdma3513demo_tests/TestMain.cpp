@@ -0,0 +1,36 @@
+#include "Tests.h"
+
+
+namespace
+{
+	struct Test
+	{
+		const char* name;
+		bool (*run)();
+	};
+
+	const Test TESTS[] = {
+		{ "world gen determinism", &test_world_gen_determinism },
+		{ "explosion matches per block", &test_explosion_matches_per_block },
+		{ "merged explosions match sequential", &test_merged_explosions_match_sequential }
+	};
+}
+
+
+int main(int argc, char* argv[])
+{
+	const int test_count = static_cast<int>(sizeof(TESTS) / sizeof(TESTS[0]));
+	int failed_count = 0;
+
+	for (const auto& test : TESTS) {
+		printf("Running test: %s..\n", test.name);
+
+		if (!test.run()) {
+			fprintf(stderr, "FAILED: %s\n", test.name);
+			++failed_count;
+		}
+	}
+
+	printf("%d of %d tests passed\n", test_count - failed_count, test_count);
+	return failed_count == 0 ? 0 : 1;
+}
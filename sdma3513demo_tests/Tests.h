@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdio>
+
+/**
+ * Checks of the game's invariants that are too slow or too broad to be asserted while it runs.
+ * Each test returns whether it passed, printing what went wrong to stderr if it didn't.
+ */
+
+// generating a world must give the same blocks whether it's done on one thread or spread over any amount of them
+bool test_world_gen_determinism();
+
+// an explosion must leave the same blocks as damaging each block in its reach one by one would
+bool test_explosion_matches_per_block();
+
+// explosions merged in the same tick must leave the same blocks as applying them one after another would
+bool test_merged_explosions_match_sequential();
+
+// fails the calling test if cond doesn't hold
+#define TEST_CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "ERROR: %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			return false; \
+		} \
+	} while (false)
@@ -0,0 +1,71 @@
+#include "Tests.h"
+
+#include <memory>
+#include <cstring>
+
+#include "World.h"
+#include "JobSystem.h"
+
+
+namespace
+{
+	// compared field by field, as chunks may have padding
+	bool chunks_equal(const BlockChunk* a, const BlockChunk* b)
+	{
+		if (!a || !b)
+			return !a && !b;
+
+		return a->block_count == b->block_count
+			&& memcmp(a->types, b->types, sizeof(a->types)) == 0
+			&& memcmp(a->healths, b->healths, sizeof(a->healths)) == 0
+			&& memcmp(a->occupied_rows, b->occupied_rows, sizeof(a->occupied_rows)) == 0
+			&& memcmp(a->solid_rows, b->solid_rows, sizeof(a->solid_rows)) == 0
+			&& memcmp(a->type_rows, b->type_rows, sizeof(a->type_rows)) == 0;
+	}
+
+	bool grids_equal(const BlockGrid& a, const BlockGrid& b)
+	{
+		for (uint32_t x = 0; x < a.get_width(); ++x)
+			TEST_CHECK(a.get_column_top(x) == b.get_column_top(x), "column top of x %u differs", x);
+
+		for (uint32_t chunk_y = 0; chunk_y < a.get_chunks_height(); ++chunk_y) {
+			for (uint32_t chunk_x = 0; chunk_x < a.get_chunks_width(); ++chunk_x)
+				TEST_CHECK(chunks_equal(a.get_chunk(chunk_x, chunk_y), b.get_chunk(chunk_x, chunk_y)), "chunk (%u, %u) differs", chunk_x, chunk_y);
+		}
+
+		return true;
+	}
+}
+
+
+bool test_world_gen_determinism()
+{
+	// the game's own size, plus sizes that leave partial chunks and bands narrower than a chunk
+	const uint32_t sizes[][2] = { { 2048, 1152 }, { 1000, 603 }, { 130, 70 } };
+	const unsigned int seeds[] = { 0, 7, 4242, 0xDEADBEEF };
+	const unsigned int thread_counts[] = { 2, 3, 8 };
+
+	std::unique_ptr<JobSystem> job_systems[sizeof(thread_counts) / sizeof(thread_counts[0])];
+	for (std::size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+		job_systems[i] = std::make_unique<JobSystem>(thread_counts[i]);
+
+	for (const auto& size : sizes) {
+		for (const auto seed : seeds) {
+			BlockGrid serial_blocks(size[0], size[1]);
+			WorldGen(serial_blocks, seed).generate_world();
+
+			for (const auto& jobs : job_systems) {
+				printf("Comparing %ux%u world of seed %u generated serially and on %u threads..\n", size[0], size[1], seed,
+					jobs->get_thread_count());
+
+				BlockGrid parallel_blocks(size[0], size[1]);
+				WorldGen(parallel_blocks, seed, WorldGenParams(), jobs.get()).generate_world();
+
+				if (!grids_equal(serial_blocks, parallel_blocks))
+					return false;
+			}
+		}
+	}
+
+	return true;
+}